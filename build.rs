@@ -31,6 +31,12 @@ fn main() {
 
     println!("cargo:rerun-if-changed=c_src/c_src/driverkit.hpp");
     println!("cargo:rerun-if-changed=c_src/c_src/driverkit.cpp");
+    println!("cargo:rerun-if-changed=c_src/report_state.hpp");
+    println!("cargo:rerun-if-changed=c_src/debounce.hpp");
+    println!("cargo:rerun-if-changed=c_src/spsc_queue.hpp");
+    println!("cargo:rerun-if-changed=c_src/event_queue.hpp");
+    println!("cargo:rerun-if-changed=c_src/pointing.hpp");
+    println!("cargo:rerun-if-changed=c_src/device_settle.hpp");
     println!("cargo:rustc-link-lib=framework=IOKit");
     println!("cargo:rustc-link-lib=framework=CoreFoundation");
 }
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+/*
+ * Key chatter suppression for one device, evaluated on the capture path
+ * before events are handed to the consumer.
+ *
+ * eager:    the first edge passes immediately; for `window` ns afterwards
+ *           an opposite edge is held back. If the key returns within the
+ *           window both edges are dropped, otherwise the held edge is
+ *           emitted when the window closes.
+ * deferred: every edge is held for `window` ns and only emitted if the
+ *           key stayed in that state; a bounce restarts the wait.
+ *
+ * The engine never reads a clock: it is driven entirely by the event
+ * timestamps given to input() and the `now` given to poll(), so replaying
+ * a recorded sequence always yields the same output. Timestamps must be
+ * monotonic. Not thread-safe except for suppressed().
+ */
+enum class debounce_algorithm : uint32_t {
+    none     = 0,
+    eager    = 1,
+    deferred = 2,
+};
+
+class debounce_engine {
+public:
+    debounce_engine(debounce_algorithm algorithm, uint64_t window)
+        : algorithm(algorithm), window(window) {}
+
+    /*
+     * Feeds one key edge observed at `timestamp`. Held edges that expired
+     * by then are flushed first, so output stays in timestamp order.
+     * emit(page, code, down, timestamp) is called for every edge let through.
+     */
+    template <typename Emit>
+    void input(uint32_t page, uint32_t code, bool down, uint64_t timestamp, Emit emit) {
+        poll(timestamp, emit);
+        if (algorithm == debounce_algorithm::none) { emit(page, code, down, timestamp); return; }
+
+        key_state& key = keys[key_id(page, code)];
+        if (down == key.raw) {
+            // Not an edge (e.g. a repeat); only forward it if nothing is held.
+            if (!key.pending) emit(page, code, down, timestamp);
+            return;
+        }
+        key.raw = down;
+
+        if (key.pending) {
+            // The key went back to the state already emitted: chatter.
+            key.pending = false;
+            pending.erase(std::find(pending.begin(), pending.end(), key_id(page, code)));
+            suppressed_events.fetch_add(2, std::memory_order_relaxed);
+            return;
+        }
+
+        if (algorithm == debounce_algorithm::deferred) {
+            hold(key, page, code, timestamp + window);
+        } else if (key.emitted_once && timestamp < key.last_emit + window) {
+            hold(key, page, code, key.last_emit + window);
+        } else {
+            key.emitted_once = true;
+            key.last_emit    = timestamp;
+            emit(page, code, down, timestamp);
+        }
+    }
+
+    // Emits every held edge whose window closed at or before `now`, oldest first.
+    template <typename Emit>
+    void poll(uint64_t now, Emit emit) {
+        while (!pending.empty()) {
+            auto next = std::min_element(pending.begin(), pending.end(), [this](uint64_t a, uint64_t b) {
+                return keys[a].deadline < keys[b].deadline;
+            });
+            uint64_t id    = *next;
+            key_state& key = keys[id];
+            if (key.deadline > now) return;
+            pending.erase(next);
+            key.pending      = false;
+            key.emitted_once = true;
+            key.last_emit    = key.deadline;
+            emit(static_cast<uint32_t>(id >> 32), static_cast<uint32_t>(id), key.raw, key.deadline);
+        }
+    }
+
+    // Earliest time poll() has something to emit, or UINT64_MAX if nothing is held.
+    uint64_t next_deadline() const {
+        uint64_t deadline = UINT64_MAX;
+        for (uint64_t id : pending) deadline = std::min(deadline, keys.at(id).deadline);
+        return deadline;
+    }
+
+    // Number of input events dropped as chatter. Safe to read from any thread.
+    uint64_t suppressed() const { return suppressed_events.load(std::memory_order_relaxed); }
+
+    // Forgets all key state and held edges; the suppressed count is kept.
+    void reset() {
+        keys.clear();
+        pending.clear();
+    }
+
+private:
+    struct key_state {
+        bool raw          = false;
+        bool emitted_once = false;
+        bool pending      = false;
+        uint64_t last_emit = 0;
+        uint64_t deadline  = 0;
+    };
+
+    static uint64_t key_id(uint32_t page, uint32_t code) { return uint64_t{page} << 32 | code; }
+
+    void hold(key_state& key, uint32_t page, uint32_t code, uint64_t deadline) {
+        key.pending  = true;
+        key.deadline = deadline;
+        pending.push_back(key_id(page, code));
+    }
+
+    debounce_algorithm algorithm;
+    uint64_t window;
+    std::unordered_map<uint64_t, key_state> keys;
+    std::vector<uint64_t> pending;
+    std::atomic<uint64_t> suppressed_events{0};
+};
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <unordered_map>
+
+/*
+ * Coalesces matched notifications for reconnecting devices. Each device
+ * hash keeps only its latest match and is handed out once no match for it
+ * has arrived for `delay` seconds, so a device that fires a burst of
+ * notifications is opened once. Deadlines are per device: one device that
+ * keeps flapping never holds up another.
+ *
+ * The caller supplies the time (CFAbsoluteTime on device_thread, a fake
+ * clock in tests) and arms its own timer for deadline(). Not thread-safe;
+ * owned by the thread that handles the notifications.
+ */
+template <typename Service>
+class settle_queue {
+public:
+    explicit settle_queue(double delay) : delay(delay) {}
+
+    /*
+     * Records a match seen at `now` and pushes that device's deadline
+     * back. Returns the older match it replaces, if any, for the caller to
+     * release.
+     */
+    std::optional<Service> add(uint64_t device_hash, Service service, double now) {
+        auto [pending, inserted] = matches.try_emplace(device_hash, match{ service, now + delay });
+        if (inserted) return std::nullopt;
+        Service replaced = pending->second.service;
+        pending->second  = { service, now + delay };
+        return replaced;
+    }
+
+    // When drain() will next hand a match out, or +infinity if none is pending.
+    double deadline() const {
+        double earliest = std::numeric_limits<double>::infinity();
+        for (auto& [hash, pending] : matches) earliest = std::min(earliest, pending.settle_at);
+        return earliest;
+    }
+
+    /*
+     * Calls open(device_hash, service) for every match that has settled by
+     * `now` and forgets it. Returns how many were handed out.
+     */
+    template <typename Open>
+    size_t drain(double now, Open open) {
+        size_t count = 0;
+        for (auto pending = matches.begin(); pending != matches.end();) {
+            if (pending->second.settle_at > now) { ++pending; continue; }
+            open(pending->first, pending->second.service);
+            pending = matches.erase(pending);
+            ++count;
+        }
+        return count;
+    }
+
+    // Forgets every pending match, calling release(service) on each.
+    template <typename Release>
+    void clear(Release release) {
+        for (auto& [hash, pending] : matches) release(pending.service);
+        matches.clear();
+    }
+
+    size_t size() const { return matches.size(); }
+
+private:
+    struct match {
+        Service service;
+        double settle_at;
+    };
+
+    double delay;
+    std::unordered_map<uint64_t, match> matches;
+};
@@ -2,18 +2,99 @@
 #include <exception>
 
 template<typename T>
-int send_key(T& keyboard, struct DKEvent* e) {
-    if(e->value == 1) keyboard.keys.insert(e->code);
-    else if(e->value == 0) keyboard.keys.erase(e->code);
-    else return 1;
+int send_key(T& channel, struct DKEvent* e) {
+    if(e->value > 1) return 1;
+    return channel.update(e->code, e->value == 1, [](const auto& report) {
+        #ifdef USE_KEXT
+        return pqrs::karabiner_virtual_hid_device_methods::post_keyboard_input_report(connect, report);
+        #else
+        client->async_post_report(report);
+        return 0;
+        #endif
+    });
+}
+
+int post_pointing_report(const pointing_input& report) {
     #ifdef USE_KEXT
-    return pqrs::karabiner_virtual_hid_device_methods::post_keyboard_input_report(connect, keyboard);
+    return pqrs::karabiner_virtual_hid_device_methods::post_pointing_input_report(connect, report);
     #else
-    client->async_post_report(keyboard);
+    if(!sink_ready.load(std::memory_order_acquire)) return 2;
+    client->async_post_report(report);
     return 0;
     #endif
 }
 
+/*
+ * Button page usages and the relative axes (generic desktop X/Y/Wheel,
+ * consumer AC Pan) go to the virtual pointing device. Returns -1 for any
+ * other event.
+ */
+int send_pointer(struct DKEvent* e) {
+    using axis = decltype(pointing)::axis;
+    axis target;
+    if(e->page == usage_pages::button) {
+        if(e->value > 1) return 1;
+        return pointing.update_button(e->code, e->value == 1, post_pointing_report);
+    }
+    else if(e->page == usage_pages::generic_desktop && e->code == pointer_usages::x)     target = axis::x;
+    else if(e->page == usage_pages::generic_desktop && e->code == pointer_usages::y)     target = axis::y;
+    else if(e->page == usage_pages::generic_desktop && e->code == pointer_usages::wheel) target = axis::vertical_wheel;
+    else if(e->page == usage_pages::consumer && e->code == pointer_usages::ac_pan)       target = axis::horizontal_wheel;
+    else return -1;
+    bool idle = pointing.add_motion(target, static_cast<int64_t>(e->value));
+    if(pointing_report_rate.load(std::memory_order_relaxed) == 0)
+        return pointing.flush_all(post_pointing_report);
+    if(idle) {
+        std::lock_guard<std::mutex> lock(pointing_mutex);
+        pointing_wakeup.notify_one();
+    }
+    return 0;
+}
+
+/*
+ * Flushes coalesced pointer motion. Sleeps until send_pointer() adds some,
+ * then posts at most one report per 1/pointing_report_rate seconds until
+ * the accumulators are drained. A rate change wakes it up and restarts the
+ * pacing; at rate 0 whatever is left is sent at once.
+ */
+void fire_pointing_thread() {
+    if (pointing_thread.joinable()) return;
+    pointing_thread_stop = false;
+    pointing_thread = std::thread{
+    []() {
+        using clock = std::chrono::steady_clock;
+        report_pacer<clock> pacer;
+        uint32_t paced_rate = 0;
+        std::unique_lock<std::mutex> lock(pointing_mutex);
+        for (;;) {
+            pointing_wakeup.wait(lock, [] { return pointing_thread_stop || pointing.has_pending(); });
+            if (pointing_thread_stop) return;
+            uint32_t rate = pointing_report_rate.load(std::memory_order_relaxed);
+            if (rate != paced_rate) { pacer = {}; paced_rate = rate; }
+            if (rate != 0 && !pacer.try_acquire(clock::now(), std::chrono::microseconds(1000000 / rate))) {
+                pointing_wakeup.wait_until(lock, pacer.next_slot(), [rate] {
+                    return pointing_thread_stop || pointing_report_rate.load(std::memory_order_relaxed) != rate;
+                });
+                continue;
+            }
+            lock.unlock();
+            if (rate == 0) pointing.flush_all(post_pointing_report);
+            else pointing.flush(post_pointing_report);
+            lock.lock();
+        }
+    } };
+}
+
+void stop_pointing_thread() {
+    if (!pointing_thread.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(pointing_mutex);
+        pointing_thread_stop = true;
+    }
+    pointing_wakeup.notify_one();
+    pointing_thread.join();
+}
+
 #ifdef USE_KEXT
 
 int init_sink() {
@@ -59,6 +140,11 @@ int init_sink() {
             return kr;
         }
     }
+    kr = pqrs::karabiner_virtual_hid_device_methods::initialize_virtual_hid_pointing(connect);
+    if (kr != KERN_SUCCESS) {
+        print_iokit_error("initialize_virtual_hid_pointing", kr);
+        return kr;
+    }
     return 0;
 }
 
@@ -69,6 +155,13 @@ int exit_sink() {
         print_iokit_error("reset_virtual_hid_keyboard", kr);
         retval = 1;
     }
+    // pointing.clear() does not post, so a button held at release would
+    // otherwise stay pressed on the virtual mouse.
+    kr = pqrs::karabiner_virtual_hid_device_methods::reset_virtual_hid_pointing(connect);
+    if (kr != KERN_SUCCESS) {
+        print_iokit_error("reset_virtual_hid_pointing", kr);
+        retval = 1;
+    }
     if (connect) {
         kr = IOServiceClose(connect);
         if(kr != KERN_SUCCESS) {
@@ -102,6 +195,7 @@ int init_sink() {
             pqrs::karabiner::driverkit::virtual_hid_device_service::virtual_hid_keyboard_parameters parameters;
             parameters.set_country_code(pqrs::hid::country_code::us);
             copy->async_virtual_hid_keyboard_initialize(parameters);
+            copy->async_virtual_hid_pointing_initialize();
         });
 
         client->virtual_hid_keyboard_ready.connect([](auto&& ready) {
@@ -167,14 +261,121 @@ int exit_sink() {
 
 #endif
 
-void fire_listener_thread() {
-    if (!listener_thread.joinable())
-        listener_thread = std::thread{
-        [&]() {
-            listener_loop = CFRunLoopGetCurrent();
-            capture_registered_devices();
+/*
+ * CFRunLoopStop() has no effect on a loop that is not running yet, so a
+ * stop requested while a thread is still setting up would be lost and its
+ * join() would hang. Every listener/device loop gets a source that stops
+ * the loop from inside instead; once signaled it stays pending until the
+ * loop runs, or until the callback the loop is busy with returns.
+ */
+void stop_current_loop(void* info) {
+    CFRunLoopStop(CFRunLoopGetCurrent());
+}
+
+CFRunLoopSourceRef add_stop_source(CFRunLoopRef loop) {
+    CFRunLoopSourceContext context = {};
+    context.perform = stop_current_loop;
+    CFRunLoopSourceRef source = CFRunLoopSourceCreate(kCFAllocatorDefault, 0, &context);
+    CFRunLoopAddSource(loop, source, kCFRunLoopDefaultMode);
+    return source;
+}
+
+void request_stop(CFRunLoopRef loop, CFRunLoopSourceRef stop_source) {
+    CFRunLoopSourceSignal(stop_source);
+    CFRunLoopWakeUp(loop);
+}
+
+/*
+ * Starts one listener thread per shard (input_callback, debounce timer)
+ * and, once their run loops are ready to receive devices, the device
+ * thread (device_loop: capture and reconnect notifications).
+ */
+void fire_listener_threads() {
+    if (input_grabbed.exchange(true, std::memory_order_acq_rel)) return;
+    input_events.open_lanes(listener_shard_count);
+    for (uint32_t i = 0; i < listener_shard_count; ++i) {
+        auto shard = std::make_unique<listener_shard>();
+        std::promise<void> shard_ready;
+        std::future<void> shard_started = shard_ready.get_future();
+        shard->thread = std::thread{
+        [self = shard.get(), shard_ready = std::move(shard_ready)]() mutable {
+            self->loop = CFRunLoopGetCurrent();
+            self->stop_source = add_stop_source(self->loop);
+            CFRunLoopSourceContext context = {};
+            context.info    = self;
+            context.perform = schedule_opened_devices;
+            self->opened_devices_source = CFRunLoopSourceCreate(kCFAllocatorDefault, 0, &context);
+            CFRunLoopAddSource(self->loop, self->opened_devices_source, kCFRunLoopDefaultMode);
+            start_debounce_timer(*self);
+            shard_ready.set_value();
             CFRunLoopRun();
+            stop_debounce_timer(*self);
+            CFRunLoopSourceInvalidate(self->opened_devices_source);
+            CFRelease(self->opened_devices_source);
+            self->opened_devices_source = nullptr;
+            CFRunLoopSourceInvalidate(self->stop_source);
+            CFRelease(self->stop_source);
+            self->stop_source = nullptr;
         } };
+        shard_started.wait();
+        listener_shards.push_back(std::move(shard));
+    }
+
+    std::promise<void> device_ready;
+    std::future<void> device_started = device_ready.get_future();
+    device_thread = std::thread{
+    [device_ready = std::move(device_ready)]() mutable {
+        device_loop = CFRunLoopGetCurrent();
+        device_stop_source = add_stop_source(device_loop);
+        const CFTimeInterval idle = 24 * 60 * 60;
+        settle_timer = CFRunLoopTimerCreate(kCFAllocatorDefault, CFAbsoluteTimeGetCurrent() + idle, idle,
+                                            0, 0, settle_timer_callback, nullptr);
+        CFRunLoopAddTimer(device_loop, settle_timer, kCFRunLoopDefaultMode);
+        // The initial capture is the loop's first callback rather than a
+        // call before CFRunLoopRun(), so a stop requested meanwhile is
+        // handled as soon as it returns.
+        CFRunLoopTimerRef initial_capture = CFRunLoopTimerCreate(kCFAllocatorDefault, CFAbsoluteTimeGetCurrent(), 0,
+                                                                 0, 0, initial_capture_callback, nullptr);
+        CFRunLoopAddTimer(device_loop, initial_capture, kCFRunLoopDefaultMode);
+        device_ready.set_value();
+        CFRunLoopRun();
+        CFRunLoopTimerInvalidate(initial_capture);
+        CFRelease(initial_capture);
+        CFRunLoopRemoveSource(device_loop, IONotificationPortGetRunLoopSource(notification_port), kCFRunLoopDefaultMode);
+        CFRunLoopTimerInvalidate(settle_timer);
+        CFRelease(settle_timer);
+        settle_timer = nullptr;
+        pending_devices.clear([](io_service_t service) { IOObjectRelease(service); });
+        CFRunLoopSourceInvalidate(device_stop_source);
+        CFRelease(device_stop_source);
+        device_stop_source = nullptr;
+    } };
+    device_started.wait();
+}
+
+// Stops the device thread first so nothing new is handed to the listeners.
+// Events the listeners queued but wait_key() never took are dropped, so a
+// later regrab_input() doesn't deliver them.
+void stop_listener_threads() {
+    // A shard blocked on a full lane (wait_key() not keeping up) can only
+    // see its stop source once push() gives up.
+    input_events.stop_producers();
+    if (device_thread.joinable()) { request_stop(device_loop, device_stop_source); device_thread.join(); }
+    for (auto& shard : listener_shards) { request_stop(shard->loop, shard->stop_source); shard->thread.join(); }
+    // Devices opened but never scheduled are still in opened_device_refs,
+    // close_registered_devices() takes care of them.
+    listener_shards.clear();
+    input_events.discard_pending();
+    input_grabbed.store(false, std::memory_order_release);
+}
+
+// Hands an event that passed debouncing to the consumer.
+void emit_event(const struct DKEvent& e) {
+    if (e.value <= 1) input_keys.set(e.device_hash, e.page, e.code, e.value == 1);
+    if (input_events.push(shard_index(e.device_hash), e)) {
+        char bell = 0;
+        write(fd[1], &bell, 1);
+    }
 }
 
 void input_callback(void* context, IOReturn result, void* sender, IOHIDValueRef value) {
@@ -184,19 +385,112 @@ void input_callback(void* context, IOReturn result, void* sender, IOHIDValueRef
     e.page = IOHIDElementGetUsagePage(element);
     e.code = IOHIDElementGetUsage(element);
     e.device_hash = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(context));
-    write(fd[1], &e, sizeof(struct DKEvent));
+    auto engine = debounce_engines.find(e.device_hash);
+    if (engine == debounce_engines.end() || e.value > 1 || tracked_page_index(e.page) < 0) {
+        emit_event(e);
+        return;
+    }
+    engine->second.input(e.page, e.code, e.value == 1, mach_to_ns(IOHIDValueGetTimeStamp(value)),
+        [hash = e.device_hash](uint32_t page, uint32_t code, bool down, uint64_t) {
+            emit_event({ down, page, code, hash });
+        });
+    schedule_debounce_timer(shard_for(e.device_hash));
+}
+
+void debounce_timer_callback(CFRunLoopTimerRef timer, void* info) {
+    listener_shard& shard = *static_cast<listener_shard*>(info);
+    uint64_t now = mach_to_ns(mach_absolute_time());
+    for (auto& [hash, engine] : debounce_engines) {
+        if (&shard_for(hash) != &shard) continue;
+        engine.poll(now, [hash = hash](uint32_t page, uint32_t code, bool down, uint64_t) {
+            emit_event({ down, page, code, hash });
+        });
+    }
+    schedule_debounce_timer(shard);
+}
+
+// Each shard's timer lives on its run loop, serves the engines of the
+// devices assigned to it and is only armed while one of them holds an edge.
+void start_debounce_timer(listener_shard& shard) {
+    if (debounce_engines.empty()) return;
+    const CFTimeInterval idle = 24 * 60 * 60;
+    CFRunLoopTimerContext context = {};
+    context.info = &shard;
+    shard.debounce_timer = CFRunLoopTimerCreate(kCFAllocatorDefault, CFAbsoluteTimeGetCurrent() + idle, idle,
+                                                0, 0, debounce_timer_callback, &context);
+    CFRunLoopAddTimer(shard.loop, shard.debounce_timer, kCFRunLoopDefaultMode);
+}
+
+void stop_debounce_timer(listener_shard& shard) {
+    if (!shard.debounce_timer) return;
+    CFRunLoopTimerInvalidate(shard.debounce_timer);
+    CFRelease(shard.debounce_timer);
+    shard.debounce_timer = nullptr;
+    // Held edges belong to the seizure that just ended.
+    for (auto& [hash, engine] : debounce_engines)
+        if (&shard_for(hash) == &shard) engine.reset();
 }
 
+void schedule_debounce_timer(listener_shard& shard) {
+    if (!shard.debounce_timer) return;
+    uint64_t deadline = UINT64_MAX;
+    for (auto& [hash, engine] : debounce_engines)
+        if (&shard_for(hash) == &shard) deadline = std::min(deadline, engine.next_deadline());
+    if (deadline == UINT64_MAX) {
+        CFRunLoopTimerSetNextFireDate(shard.debounce_timer, CFAbsoluteTimeGetCurrent() + 24 * 60 * 60);
+        return;
+    }
+    uint64_t now = mach_to_ns(mach_absolute_time());
+    double delay = deadline > now ? (deadline - now) / 1e9 : 0;
+    CFRunLoopTimerSetNextFireDate(shard.debounce_timer, CFAbsoluteTimeGetCurrent() + delay);
+}
+
+/*
+ * Runs on device_thread. A reconnecting keyboard can fire several matched
+ * notifications in a row, so matches are only recorded here and opened
+ * once they have settled (see settle_timer_callback).
+ */
 void device_connected_callback(void* context, io_iterator_t iter) {
     uint64_t device_hash = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(context));
     for (mach_port_t curr = IOIteratorNext(iter); curr; curr = IOIteratorNext(iter)) {
-        uint64_t curr_hash = hash_device(curr);
-        if ( curr_hash == device_hash )
-            capture_device(IOHIDDeviceCreate(kCFAllocatorDefault, curr), curr_hash);
-        IOObjectRelease(curr);
+        if ( hash_device(curr) != device_hash ) { IOObjectRelease(curr); continue; }
+        if (auto replaced = pending_devices.add(device_hash, curr, CFAbsoluteTimeGetCurrent()))
+            IOObjectRelease(*replaced);
+        CFRunLoopTimerSetNextFireDate(settle_timer, pending_devices.deadline());
     }
 }
 
+void settle_timer_callback(CFRunLoopTimerRef timer, void* info) {
+    CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+    pending_devices.drain(now, [](uint64_t hash, io_service_t service) {
+        capture_device(IOHIDDeviceCreate(kCFAllocatorDefault, service), hash);
+        IOObjectRelease(service);
+    });
+    // Re-arm for anything still pending (if the timer fired a hair early),
+    // otherwise park the timer.
+    CFRunLoopTimerSetNextFireDate(settle_timer, std::min(pending_devices.deadline(), now + 24 * 60 * 60));
+}
+
+void initial_capture_callback(CFRunLoopTimerRef timer, void* info) {
+    capture_registered_devices();
+}
+
+// Runs on a listener shard when device_thread signals its opened_devices_source.
+void schedule_opened_devices(void* info) {
+    listener_shard& shard = *static_cast<listener_shard*>(info);
+    for (opened_device device; shard.opened_devices.pop(device);) {
+        // A device that dropped never sent releases for the keys it held,
+        // and an edge held back from before the drop must not be flushed.
+        input_keys.clear(device.device_hash);
+        if (auto engine = debounce_engines.find(device.device_hash); engine != debounce_engines.end())
+            engine->second.reset();
+        void* ctx = reinterpret_cast<void*>(static_cast<uintptr_t>(device.device_hash));
+        IOHIDDeviceRegisterInputValueCallback(device.device_ref, input_callback, ctx);
+        IOHIDDeviceScheduleWithRunLoop(device.device_ref, shard.loop, kCFRunLoopDefaultMode);
+    }
+    schedule_debounce_timer(shard);
+}
+
 void close_registered_devices() {
     for(auto& [hash, device_ref] : opened_device_refs) {
         kern_return_t kr = IOHIDDeviceClose(device_ref, kIOHIDOptionsTypeSeizeDevice);
@@ -248,22 +542,29 @@ void subscribe_to_notification(const char* notification_type, void* cb_arg, call
 }
 
 bool capture_device(IOHIDDeviceRef device_ref, uint64_t device_hash) {
+    // IOHIDDeviceCreate() returns NULL when the service terminated in the
+    // meantime, e.g. a keyboard that dropped again while its match settled.
+    if (!device_ref) return false;
     kern_return_t kr = IOHIDDeviceOpen(device_ref, kIOHIDOptionsTypeSeizeDevice);
     if(kr != kIOReturnSuccess) {
         print_iokit_error("IOHIDDeviceOpen", kr, CFStringToStdString(get_device_name(device_ref)));
         CFRelease(device_ref);
         return false;
     }
-    void* ctx = reinterpret_cast<void*>(static_cast<uintptr_t>(device_hash));
-    IOHIDDeviceRegisterInputValueCallback(device_ref, input_callback, ctx);
-    IOHIDDeviceScheduleWithRunLoop(device_ref, listener_loop, kCFRunLoopDefaultMode);
     opened_device_refs[device_hash] = device_ref;
+    // Hand the seized device to its listener shard; the queue is only full if
+    // the shard is 64 devices behind, so wait for it to catch up.
+    listener_shard& shard = shard_for(device_hash);
+    while (!shard.opened_devices.push({ device_ref, device_hash }))
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    CFRunLoopSourceSignal(shard.opened_devices_source);
+    CFRunLoopWakeUp(shard.loop);
     return true;
 }
 
 bool capture_registered_devices() {
     // Register the notification port to the run loop, essential for receiving re-connect events so we can re-capture devices
-    CFRunLoopAddSource(listener_loop, IONotificationPortGetRunLoopSource(notification_port), kCFRunLoopDefaultMode);
+    CFRunLoopAddSource(device_loop, IONotificationPortGetRunLoopSource(notification_port), kCFRunLoopDefaultMode);
     return consume_devices([](mach_port_t c) {
         uint64_t device_hash = hash_device(c);
         if ( registered_devices_hashes.find(device_hash) != registered_devices_hashes.end() ) {
@@ -288,6 +589,40 @@ IOHIDDeviceRef get_device_by_hash(uint64_t device_hash) {
     return nullptr;
 }
 
+#ifdef USE_KEXT
+#define PQRS_USAGE_PAGE(name) static_cast<uint32_t>(pqrs::karabiner_virtual_hid_device::usage_page::name)
+#else
+#define PQRS_USAGE_PAGE(name) static_cast<uint32_t>(type_safe::get(pqrs::hid::usage_page::name))
+#endif
+static_assert(PQRS_USAGE_PAGE(generic_desktop)       == usage_pages::generic_desktop);
+static_assert(PQRS_USAGE_PAGE(keyboard_or_keypad)    == usage_pages::keyboard_or_keypad);
+static_assert(PQRS_USAGE_PAGE(consumer)              == usage_pages::consumer);
+static_assert(PQRS_USAGE_PAGE(apple_vendor_top_case) == usage_pages::apple_vendor_top_case);
+static_assert(PQRS_USAGE_PAGE(apple_vendor_keyboard) == usage_pages::apple_vendor_keyboard);
+#undef PQRS_USAGE_PAGE
+
+/*
+ * The one place usage pages are mapped to output report channels: returns
+ * f(channel) for a keyboard-style page, `other` for anything else. Used by
+ * send_key() and by the pressed-key queries.
+ */
+template <typename Result, typename Func>
+Result with_output_channel(uint32_t page, Result other, Func f) {
+    switch (page) {
+        case usage_pages::generic_desktop:       return f(generic_desktop);
+        case usage_pages::keyboard_or_keypad:    return f(keyboard);
+        case usage_pages::consumer:              return f(consumer);
+        case usage_pages::apple_vendor_top_case: return f(top_case);
+        case usage_pages::apple_vendor_keyboard: return f(apple_keyboard);
+        default:                                 return other;
+    }
+}
+
+// Returns the key state of the virtual keyboard's report for a usage page.
+const atomic_key_bitmap<>* output_state(uint32_t page) {
+    return with_output_channel<const atomic_key_bitmap<>*>(page, nullptr, [](auto& channel) { return &channel.state(); });
+}
+
 uint64_t fnv_hash(const std::string& key) {
     const uint64_t FNV_OFFSET = 14695981039346656037ull;
     const uint64_t FNV_PRIME  = 1099511628211ull;
@@ -365,8 +700,20 @@ extern "C" {
     }
     #endif
 
-    // Reads a new key event from the pipe, blocking until a new event is ready.
-    int wait_key(struct DKEvent* e) { return read(fd[0], e, sizeof(struct DKEvent)) == sizeof(struct DKEvent); }
+    /*
+     * Reads the next key event from any listener shard, blocking until one
+     * is ready. Returns 0 once input has been released (the wake-up pipe is
+     * closed).
+     */
+    int wait_key(struct DKEvent* e) {
+        for (;;) {
+            if (input_events.try_pop(*e)) return 1;
+            input_events.prepare_wait();
+            if (input_events.try_pop(*e)) return 1;
+            char bell;
+            if (read(fd[0], &bell, 1) != 1) return 0;
+        }
+    }
 
     bool device_matches(const char* product) {
         if (!product) return true;
@@ -391,9 +738,9 @@ extern "C" {
     /*
      * Opens and seizes input from each keyboard device whose product name
      * matches the parameter (if NULL is received, then it opens all
-     * keyboard devices). Spawns a thread to receive asynchronous input
-     * and opens a pipe for this thread to send key event data to the main
-     * thread.
+     * keyboard devices). Spawns listener threads to receive asynchronous
+     * input (see set_listener_shards()) and opens a pipe used to wake the
+     * main thread up when they queue key events for it.
      *
      * Loads a the karabiner kernel extension that will send key events
      * back to the OS.
@@ -408,7 +755,8 @@ extern "C" {
         // before taking exclusive control of the keyboard.
         int sink_err = init_sink();
         if (sink_err) return sink_err;
-        fire_listener_thread();
+        fire_pointing_thread();
+        fire_listener_threads();
         return 0;
     }
 
@@ -418,10 +766,13 @@ extern "C" {
      */
     void release() {
         std::cout << "release called" << std::endl;
-        if(listener_thread.joinable()) { CFRunLoopStop(listener_loop); listener_thread.join(); }
+        stop_listener_threads();
         close_registered_devices();
-        keyboard.keys.clear();
+        input_keys.clear();
+        keyboard.clear();
         close(fd[0]); close(fd[1]);
+        stop_pointing_thread();
+        pointing.clear();
         exit_sink();
     }
 
@@ -429,37 +780,22 @@ extern "C" {
      * Rust calls this with a new key event to send back to the OS. It
      * posts the information to the karabiner kernel extension (which
      * represents a virtual keyboard).
+     *
+     * Safe to call from several threads at once: key state is kept in
+     * per-page atomic bitmaps and reports are rebuilt from them (see
+     * report_channel in report_state.hpp).
+     *
+     * Button page (0x09) usages press/release buttons of the virtual
+     * pointing device. Generic desktop X/Y/Wheel and consumer AC Pan take
+     * `value` as a signed relative delta; deltas are accumulated and
+     * posted at the rate set by set_pointer_report_rate().
      */
     int send_key(struct DKEvent* e) {
-        #ifdef USE_KEXT
-        auto usage_page = pqrs::karabiner_virtual_hid_device::usage_page(e->page);
-        if(usage_page == pqrs::karabiner_virtual_hid_device::usage_page::keyboard_or_keypad)
-            return send_key(keyboard, e);
-        else if(usage_page == pqrs::karabiner_virtual_hid_device::usage_page::apple_vendor_top_case)
-            return send_key(top_case, e);
-        else if(usage_page == pqrs::karabiner_virtual_hid_device::usage_page::apple_vendor_keyboard)
-            return send_key(apple_keyboard, e);
-        else if(usage_page == pqrs::karabiner_virtual_hid_device::usage_page::consumer)
-            return send_key(consumer, e);
-        else if(usage_page == pqrs::karabiner_virtual_hid_device::usage_page::generic_desktop)
-            return send_key(generic_desktop, e);
-        else
-            return 1;
-        #else
+        #ifndef USE_KEXT
         if(!sink_ready.load(std::memory_order_acquire)) return 2;
-        auto usage_page = pqrs::hid::usage_page::value_t(e->page);
-        if(usage_page == pqrs::hid::usage_page::keyboard_or_keypad)
-            return send_key(keyboard, e);
-        else if(usage_page == pqrs::hid::usage_page::apple_vendor_top_case)
-            return send_key(top_case, e);
-        else if(usage_page == pqrs::hid::usage_page::apple_vendor_keyboard)
-            return send_key(apple_keyboard, e);
-        else if(usage_page == pqrs::hid::usage_page::consumer)
-            return send_key(consumer, e);
-        else if(usage_page == pqrs::hid::usage_page::generic_desktop)
-            return send_key(generic_desktop, e);
-        else return 1;
         #endif
+        if (int pointer_result = send_pointer(e); pointer_result >= 0) return pointer_result;
+        return with_output_channel(e->page, 1, [e](auto& channel) { return send_key(channel, e); });
     }
 
     const DeviceData* get_device_list(size_t* array_length) {
@@ -501,13 +837,10 @@ extern "C" {
      */
     void release_input_only() {
         #ifndef USE_KEXT
-        if(listener_thread.joinable()) {
-            CFRunLoopRemoveSource(listener_loop, IONotificationPortGetRunLoopSource(notification_port), kCFRunLoopDefaultMode);
-            CFRunLoopStop(listener_loop);
-            listener_thread.join();
-        }
+        stop_listener_threads();
         close_registered_devices();
-        keyboard.keys.clear();
+        input_keys.clear();
+        keyboard.clear();
         close(fd[0]); close(fd[1]);
         #endif
     }
@@ -523,11 +856,102 @@ extern "C" {
         #else
         if (!registered_devices_hashes.size()) return false;
         if (pipe(fd) == -1) { std::cerr << "pipe error: " << errno << std::endl; return false; }
-        fire_listener_thread();
+        fire_listener_threads();
         return true;
         #endif
     }
 
+    /*
+     * Pressed-key queries. The input side reflects what input_callback()
+     * last saw on each seized device, the output side what send_key() last
+     * asserted on the virtual keyboard. All of these are lock-free and may
+     * be called from any thread.
+     */
+    bool is_key_down(uint64_t device_hash, uint32_t page, uint32_t code) {
+        return input_keys.test(device_hash, page, code);
+    }
+
+    bool is_output_key_down(uint32_t page, uint32_t code) {
+        const atomic_key_bitmap<>* state = output_state(page);
+        return state && state->test(code);
+    }
+
+    /*
+     * Fill `keys` with up to `capacity` pressed keys (value = 1) and return
+     * the total number pressed; call again with a larger buffer if the
+     * result exceeds `capacity`.
+     */
+    size_t get_pressed_keys(uint64_t device_hash, struct DKEvent* keys, size_t capacity) {
+        size_t count = 0;
+        input_keys.for_each(device_hash, [&](uint32_t page, uint32_t code) {
+            if (count < capacity) keys[count] = { 1, page, code, device_hash };
+            ++count;
+        });
+        return count;
+    }
+
+    size_t get_output_pressed_keys(struct DKEvent* keys, size_t capacity) {
+        size_t count = 0;
+        for (uint32_t page : tracked_pages)
+            output_state(page)->for_each([&](uint32_t code) {
+                if (count < capacity) keys[count] = { 1, page, code, 0 };
+                ++count;
+            });
+        return count;
+    }
+
+    /*
+     * Sets how many listener threads seized devices are spread over
+     * (by device hash). Must be called before grab()/regrab_input() and
+     * while input is released; returns false otherwise or if `count` is
+     * outside 1..max_listener_shards.
+     */
+    bool set_listener_shards(uint32_t count) {
+        if (count == 0 || count > max_listener_shards || input_grabbed.load(std::memory_order_acquire)) return false;
+        listener_shard_count = count;
+        return true;
+    }
+
+    /*
+     * Sets how many pointer reports per second coalesced motion is flushed
+     * at (e.g. 125, 250, 1000). 0 posts every motion event immediately.
+     * May be called at any time; returns false above max_pointing_report_rate.
+     */
+    bool set_pointer_report_rate(uint32_t rate_hz) {
+        if (rate_hz > max_pointing_report_rate) return false;
+        pointing_report_rate.store(rate_hz, std::memory_order_relaxed);
+        // The pointing thread may be waiting for a slot at the old rate.
+        std::lock_guard<std::mutex> lock(pointing_mutex);
+        pointing_wakeup.notify_one();
+        return true;
+    }
+
+    /*
+     * Enables chatter suppression for a device (see debounce.hpp):
+     * algorithm 0 = off, 1 = eager, 2 = deferred; window in milliseconds.
+     * Like register_device(), must be called before grab()/regrab_input().
+     * The configuration is frozen while input is grabbed, so this returns
+     * false then, as well as for an unknown algorithm.
+     */
+    bool set_debounce(uint64_t device_hash, uint32_t algorithm, uint32_t window_ms) {
+        if (algorithm > static_cast<uint32_t>(debounce_algorithm::deferred)) return false;
+        if (input_grabbed.load(std::memory_order_acquire)) return false;
+        debounce_engines.erase(device_hash);
+        if (algorithm != static_cast<uint32_t>(debounce_algorithm::none))
+            debounce_engines.try_emplace(device_hash, debounce_algorithm(algorithm), uint64_t{window_ms} * 1000000);
+        return true;
+    }
+
+    /*
+     * Number of events dropped as chatter on a device since set_debounce().
+     * Safe from any thread while input is grabbed; while released, don't
+     * call it concurrently with set_debounce().
+     */
+    uint64_t get_debounce_suppressed(uint64_t device_hash) {
+        auto engine = debounce_engines.find(device_hash);
+        return engine == debounce_engines.end() ? 0 : engine->second.suppressed();
+    }
+
 }
 
 // main function is just for testing
@@ -555,7 +979,7 @@ int main() {
                   std::hex << " hash: " << hash << std::dec << " dev: " << get_device_by_hash(hash) << std::endl;
 
     grab();
-    listener_thread.join();
+    device_thread.join();
     release();
 
     return 0;
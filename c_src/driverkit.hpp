@@ -1,14 +1,26 @@
 #include <unistd.h>
 #include <atomic>
+#include <condition_variable>
+#include <future>
+#include <mutex>
 #include <thread>
 #include <iostream>
 #include <mach/mach_error.h>
+#include <mach/mach_time.h>
 #include <AvailabilityMacros.h>
 #include <filesystem> // Include this before virtual_hid_device_service.hpp to avoid compile error
 #include <IOKit/hid/IOHIDLib.h>
 #include <IOKit/hidsystem/IOHIDShared.h>
+#include <memory>
 #include <set>
 #include <unordered_map>
+#include <vector>
+#include "report_state.hpp"
+#include "debounce.hpp"
+#include "spsc_queue.hpp"
+#include "event_queue.hpp"
+#include "pointing.hpp"
+#include "device_settle.hpp"
 
 /* The name was changed from "Master" to "Main" in Apple SDK 12.0 (Monterey) */
 #if (MAC_OS_X_VERSION_MIN_REQUIRED < 120000) // Before macOS 12 Monterey
@@ -19,11 +31,12 @@
     #include "karabiner_virtual_hid_device_methods.hpp"
     mach_port_t connect;
     io_service_t service;
-    pqrs::karabiner_virtual_hid_device::hid_report::keyboard_input keyboard;
-    pqrs::karabiner_virtual_hid_device::hid_report::apple_vendor_top_case_input top_case;
-    pqrs::karabiner_virtual_hid_device::hid_report::apple_vendor_keyboard_input apple_keyboard;
-    pqrs::karabiner_virtual_hid_device::hid_report::consumer_input consumer;
-    pqrs::karabiner_virtual_hid_device::hid_report::generic_desktop_input generic_desktop;
+    report_channel<pqrs::karabiner_virtual_hid_device::hid_report::keyboard_input> keyboard;
+    report_channel<pqrs::karabiner_virtual_hid_device::hid_report::apple_vendor_top_case_input> top_case;
+    report_channel<pqrs::karabiner_virtual_hid_device::hid_report::apple_vendor_keyboard_input> apple_keyboard;
+    report_channel<pqrs::karabiner_virtual_hid_device::hid_report::consumer_input> consumer;
+    report_channel<pqrs::karabiner_virtual_hid_device::hid_report::generic_desktop_input> generic_desktop;
+    using pointing_input = pqrs::karabiner_virtual_hid_device::hid_report::pointing_input;
 #else
     #include "virtual_hid_device_driver.hpp"
     #include "virtual_hid_device_service.hpp"
@@ -31,28 +44,82 @@
     // Tracks whether the DriverKit virtual keyboard is ready for output.
     // Written by pqrs dispatcher callbacks, read by the event loop thread.
     std::atomic<bool> sink_ready{false};
-    pqrs::karabiner::driverkit::virtual_hid_device_driver::hid_report::keyboard_input keyboard;
-    pqrs::karabiner::driverkit::virtual_hid_device_driver::hid_report::apple_vendor_top_case_input top_case;
-    pqrs::karabiner::driverkit::virtual_hid_device_driver::hid_report::apple_vendor_keyboard_input apple_keyboard;
-    pqrs::karabiner::driverkit::virtual_hid_device_driver::hid_report::consumer_input consumer;
-    pqrs::karabiner::driverkit::virtual_hid_device_driver::hid_report::generic_desktop_input generic_desktop;
+    report_channel<pqrs::karabiner::driverkit::virtual_hid_device_driver::hid_report::keyboard_input> keyboard;
+    report_channel<pqrs::karabiner::driverkit::virtual_hid_device_driver::hid_report::apple_vendor_top_case_input> top_case;
+    report_channel<pqrs::karabiner::driverkit::virtual_hid_device_driver::hid_report::apple_vendor_keyboard_input> apple_keyboard;
+    report_channel<pqrs::karabiner::driverkit::virtual_hid_device_driver::hid_report::consumer_input> consumer;
+    report_channel<pqrs::karabiner::driverkit::virtual_hid_device_driver::hid_report::generic_desktop_input> generic_desktop;
+    using pointing_input = pqrs::karabiner::driverkit::virtual_hid_device_driver::hid_report::pointing_input;
 #endif
 
+// Virtual pointing device. Motion is coalesced and flushed by pointing_thread
+// at most pointing_report_rate times per second (0 = post every event).
+pointer_channel<pointing_input> pointing;
+std::thread pointing_thread;
+std::mutex pointing_mutex;
+std::condition_variable pointing_wakeup;
+bool pointing_thread_stop = false;
+std::atomic<uint32_t> pointing_report_rate{125};
+constexpr uint32_t max_pointing_report_rate = 1000;
+
 IONotificationPortRef notification_port = IONotificationPortCreate(kIOMainPortDefault);
-std::thread listener_thread;
-CFRunLoopRef listener_loop;
+// Device management (matching notifications, IOHIDDeviceOpen) runs on its own
+// thread so a slow or bursty reconnect never stalls input_callback().
+std::thread device_thread;
+CFRunLoopRef device_loop;
+CFRunLoopSourceRef device_stop_source = nullptr;
+// A device that device_thread has opened and seized, waiting to be scheduled
+// on its listener shard.
+struct opened_device {
+    IOHIDDeviceRef device_ref;
+    uint64_t device_hash;
+};
+/*
+ * Seized devices are spread by hash over listener_shard_count listener
+ * threads. Each shard has its own run loop, debounce timer and lane in
+ * input_events, so busy devices don't queue behind each other.
+ */
+struct listener_shard {
+    std::thread thread;
+    CFRunLoopRef loop = nullptr;
+    CFRunLoopSourceRef stop_source = nullptr;
+    spsc_queue<opened_device, 64> opened_devices;
+    CFRunLoopSourceRef opened_devices_source = nullptr;
+    CFRunLoopTimerRef debounce_timer = nullptr;
+};
+constexpr uint32_t max_listener_shards = 16;
+uint32_t listener_shard_count = 1;
+std::vector<std::unique_ptr<listener_shard>> listener_shards;
+// Set from fire_listener_threads() until stop_listener_threads() returns.
+// Configuration the listeners read (shard count, debounce engines) is only
+// changed while this is false.
+std::atomic<bool> input_grabbed{false};
+// Matched notifications are coalesced per device hash until none has
+// arrived for device_settle_delay seconds; only touched by device_thread.
+constexpr CFTimeInterval device_settle_delay = 0.05;
+settle_queue<io_service_t> pending_devices{device_settle_delay};
+CFRunLoopTimerRef settle_timer = nullptr;
 std::set<uint64_t> registered_devices_hashes;
 // Maps device hash → the IOHIDDeviceRef that was opened with kIOHIDOptionsTypeSeizeDevice.
 // close_registered_devices() must close the SAME ref that capture_device() opened;
 // creating a new ref via IOHIDDeviceCreate() and closing that does NOT release the seizure.
+// Written by device_thread, read once both threads are stopped.
 std::unordered_map<uint64_t, IOHIDDeviceRef> opened_device_refs;
+// Keys currently held on each seized device, as last seen by input_callback().
+device_key_state<> input_keys;
+// Debounce engines by device hash. The map is only changed while input is
+// released; while grabbed each engine is only touched by its device's
+// listener shard, and suppressed() may be read from anywhere.
+std::unordered_map<uint64_t, debounce_engine> debounce_engines;
 
+// Only used to wake wait_key() up while it is blocked on input_events.
 int fd[2];
 CFMutableDictionaryRef matching_dictionary = NULL;
 
 /*
  * Key event information that's shared between C++ and Rust
- * value: represents key up or key down
+ * value: represents key up or key down, or a signed (two's complement)
+ *        relative delta for pointer axes (see send_key())
  * page: represents IOKit usage page
  * code: represents IOKit usage
  * device_hash: FNV-1a hash identifying which physical device sent the event
@@ -64,6 +131,12 @@ struct DKEvent {
     uint64_t device_hash;
 };
 
+// Events from all listener shards, one lane per shard, merged in arrival
+// order for wait_key(). Lives as long as the process, since wait_key() may
+// be reading it from another thread across release()/regrab_input(); lanes
+// are only allocated for the shards actually started.
+sequenced_event_queue<DKEvent> input_events{max_listener_shards};
+
 /*
  * Device data
  * product_key: device name IOKit (kIOHIDProductKey)
@@ -79,10 +152,23 @@ struct DeviceData {
 using callback_type = void(*)(void*, io_iterator_t);
 void subscribe_to_notification(const char* notification_type, void* cb_arg, callback_type callback);
 void device_connected_callback(void* context, io_iterator_t iter);
-void fire_listener_thread();
+void fire_listener_threads();
+void stop_listener_threads();
+void fire_pointing_thread();
+void stop_pointing_thread();
+int  post_pointing_report(const pointing_input& report);
+void schedule_opened_devices(void* info);
+void settle_timer_callback(CFRunLoopTimerRef timer, void* info);
+void initial_capture_callback(CFRunLoopTimerRef timer, void* info);
+CFRunLoopSourceRef add_stop_source(CFRunLoopRef loop);
+void request_stop(CFRunLoopRef loop, CFRunLoopSourceRef stop_source);
 void init_keyboards_dictionary();
 void close_registered_devices();
 void input_callback(void* context, IOReturn result, void* sender, IOHIDValueRef value);
+void emit_event(const struct DKEvent& e);
+void start_debounce_timer(listener_shard& shard);
+void stop_debounce_timer(listener_shard& shard);
+void schedule_debounce_timer(listener_shard& shard);
 
 template <typename Func>
 bool consume_devices(Func consume);
@@ -107,11 +193,24 @@ uint64_t hash_device(mach_port_t device);
 io_iterator_t get_keyboards_iterator();
 IOHIDDeviceRef get_device_by_hash(uint64_t device_hash);
 
+inline size_t shard_index(uint64_t device_hash) { return device_hash % listener_shards.size(); }
+inline listener_shard& shard_for(uint64_t device_hash) { return *listener_shards[shard_index(device_hash)]; }
+
 // Helper functions...
 inline void print_iokit_error(const char* fname, int freturn, std::string data = "") {
     std::cerr << fname << " error: " << ( freturn ? mach_error_string(freturn) : "" ) << " " << data << std::endl;
 }
 
+// Converts mach absolute time (as used by IOHIDValue timestamps) to nanoseconds.
+inline uint64_t mach_to_ns(uint64_t mach_time) {
+    static mach_timebase_info_data_t timebase = [] {
+        mach_timebase_info_data_t info;
+        mach_timebase_info(&info);
+        return info;
+    }();
+    return mach_time * timebase.numer / timebase.denom;
+}
+
 inline CFStringRef from_cstr( const char* str) {
     if (!str) return nullptr;
     return CFStringCreateWithCString(kCFAllocatorDefault, str, CFStringGetSystemEncoding());
@@ -222,4 +321,14 @@ extern "C" {
     bool is_sink_ready();
     void release_input_only();
     bool regrab_input();
+
+    bool is_key_down(uint64_t device_hash, uint32_t page, uint32_t code);
+    bool is_output_key_down(uint32_t page, uint32_t code);
+    size_t get_pressed_keys(uint64_t device_hash, struct DKEvent* keys, size_t capacity);
+    size_t get_output_pressed_keys(struct DKEvent* keys, size_t capacity);
+
+    bool set_listener_shards(uint32_t count);
+    bool set_pointer_report_rate(uint32_t rate_hz);
+    bool set_debounce(uint64_t device_hash, uint32_t algorithm, uint32_t window_ms);
+    uint64_t get_debounce_suppressed(uint64_t device_hash);
 }
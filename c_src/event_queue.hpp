@@ -0,0 +1,130 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include "spsc_queue.hpp"
+
+/*
+ * Merges events from several producer threads ("lanes") into a single
+ * consumer view ordered by a global sequence number.
+ *
+ * Each lane is an spsc_queue written by exactly one thread. push() takes
+ * the next sequence number and appends to its lane; try_pop() only
+ * returns the event whose number is next in line, so the consumer sees
+ * events in the order they were pushed across all lanes. An event whose
+ * number is taken but not yet visible simply makes try_pop() fail until
+ * its producer finishes the push.
+ *
+ * Blocking is left to the caller: prepare_wait() before sleeping, then
+ * retry try_pop(); push() returns true when a sleeping consumer has to be
+ * woken up. The handshake is an exchange on a per-lane flag from both
+ * sides rather than standalone fences, so ThreadSanitizer can check it.
+ *
+ * The queue is meant to live as long as its consumer: producers may come
+ * and go. Lanes are allocated by open_lanes() and never freed, so the
+ * consumer may keep running while producers are stopped, and
+ * discard_pending() drops whatever they left behind without touching
+ * consumer state.
+ */
+template <typename Event, size_t LaneCapacity = 4096>
+class sequenced_event_queue {
+public:
+    explicit sequenced_event_queue(size_t max_lanes)
+        : max_lanes(max_lanes), lanes(new std::unique_ptr<lane>[max_lanes]) {}
+
+    // Number of lanes open so far.
+    size_t size() const { return opened.load(std::memory_order_acquire); }
+
+    /*
+     * Makes lanes 0..count-1 (at most max_lanes) available to producers,
+     * allocating any not opened before, and lets push() wait for space
+     * again after stop_producers(). Call before the producers start.
+     */
+    void open_lanes(size_t count) {
+        count = std::min(count, max_lanes);
+        for (size_t i = opened.load(std::memory_order_relaxed); i < count; ++i) lanes[i].reset(new lane);
+        if (count > opened.load(std::memory_order_relaxed)) opened.store(count, std::memory_order_release);
+        stopping.store(false, std::memory_order_release);
+    }
+
+    /*
+     * Producer side: only ever called from the thread that owns `lane`.
+     * Waits while the lane is full; after stop_producers() it drops the
+     * event instead, returning false.
+     */
+    bool push(size_t lane_index, const Event& event) {
+        lane& target = *lanes[lane_index];
+        // The sequence number is only taken once there is room, so a
+        // dropped event never leaves a gap the consumer would wait on, and
+        // nothing the consumer needs next can be stuck behind this wait.
+        while (target.events.full()) {
+            if (stopping.load(std::memory_order_acquire)) return false;
+            std::this_thread::yield();
+        }
+        target.events.push({ next_sequence.fetch_add(1, std::memory_order_relaxed), event });
+        // Either the consumer armed this flag before now and has to be
+        // woken, or its own exchange will observe the push above.
+        return target.waiting.exchange(false, std::memory_order_acq_rel);
+    }
+
+    // Makes producers blocked on a full lane give up, e.g. for shutdown.
+    void stop_producers() { stopping.store(true, std::memory_order_release); }
+
+    // Consumer side: single thread.
+    bool try_pop(Event& event) {
+        entry item{};
+        do {
+            if (!pop_expected(item)) return false;
+        } while (item.sequence < discard_below.load(std::memory_order_acquire));
+        event = item.event;
+        return true;
+    }
+
+    // Consumer side: call before sleeping, then retry try_pop().
+    void prepare_wait() {
+        for (size_t i = 0, count = size(); i < count; ++i)
+            lanes[i]->waiting.exchange(true, std::memory_order_acq_rel);
+    }
+
+    /*
+     * Makes try_pop() skip every event pushed so far. Only call while no
+     * producer is pushing; the consumer may keep running.
+     */
+    void discard_pending() {
+        discard_below.store(next_sequence.load(std::memory_order_relaxed), std::memory_order_release);
+    }
+
+private:
+    struct entry {
+        uint64_t sequence;
+        Event event;
+    };
+    struct lane {
+        spsc_queue<entry, LaneCapacity> events;
+        alignas(64) std::atomic<bool> waiting{false};
+    };
+
+    // Pops the entry numbered `expected`, whichever lane it is in.
+    bool pop_expected(entry& item) {
+        for (size_t i = 0, count = size(); i < count; ++i) {
+            const entry* front = lanes[i]->events.front();
+            if (!front || front->sequence != expected) continue;
+            lanes[i]->events.pop(item);
+            ++expected;
+            return true;
+        }
+        return false;
+    }
+
+    size_t max_lanes;
+    std::unique_ptr<std::unique_ptr<lane>[]> lanes;
+    std::atomic<size_t> opened{0};
+    std::atomic<bool> stopping{false};
+    std::atomic<uint64_t> next_sequence{0};
+    std::atomic<uint64_t> discard_below{0};
+    uint64_t expected = 0;
+};
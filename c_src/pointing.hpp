@@ -0,0 +1,149 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include "report_state.hpp"
+
+// Usages of the relative axes send_key() takes as pointer motion.
+namespace pointer_usages {
+constexpr uint32_t x      = 0x30;  // generic desktop X
+constexpr uint32_t y      = 0x31;  // generic desktop Y
+constexpr uint32_t wheel  = 0x38;  // generic desktop Wheel
+constexpr uint32_t ac_pan = 0x238; // consumer AC Pan
+}
+
+/*
+ * Relative pointer output: motion from any number of threads is summed in
+ * atomic accumulators and drained into reports by flush(), so high-rate
+ * movement costs one report per flush instead of one per event. Buttons
+ * are reported immediately. Kept free of IOKit/pqrs includes, Report only
+ * needs `buttons.insert()` and int8 `x`, `y`, `vertical_wheel` and
+ * `horizontal_wheel` fields.
+ */
+template <typename Report>
+class pointer_channel {
+public:
+    enum axis : size_t { x, y, vertical_wheel, horizontal_wheel, axis_count };
+
+    static constexpr uint32_t max_buttons = 32;
+
+    /*
+     * Presses/releases button 1..max_buttons and posts a report right away
+     * (carrying any pending motion). Returns 1 for other buttons.
+     */
+    template <typename Post>
+    int update_button(uint32_t button, bool down, Post post) {
+        if (button == 0 || button > max_buttons) return 1;
+        uint32_t mask = uint32_t{1} << (button - 1);
+        if (down) buttons.fetch_or(mask, std::memory_order_release);
+        else      buttons.fetch_and(~mask, std::memory_order_release);
+        return flush(post);
+    }
+
+    /*
+     * Adds relative motion without posting. Returns true if the channel
+     * had no pending motion before, i.e. whoever flushes it has to be
+     * woken up.
+     */
+    bool add_motion(axis a, int64_t delta) {
+        motion[a].fetch_add(delta, std::memory_order_relaxed);
+        return !pending.exchange(true, std::memory_order_acq_rel);
+    }
+
+    // True while motion has been added but not flushed yet.
+    bool has_pending() const { return pending.load(std::memory_order_acquire); }
+
+    /*
+     * Posts one report with the current buttons and as much pending motion
+     * as fits (-127..127 per axis). Anything left over stays pending for
+     * the next flush.
+     */
+    template <typename Post>
+    int flush(Post post) {
+        // Acquire whatever add_motion() published before setting `pending`.
+        pending.exchange(false, std::memory_order_acq_rel);
+        return poster.post([&] {
+            Report report;
+            uint32_t pressed = buttons.load(std::memory_order_acquire);
+            for (uint32_t button = 1; pressed; ++button, pressed >>= 1)
+                if (pressed & 1) report.buttons.insert(button);
+            report.x                = take(x);
+            report.y                = take(y);
+            report.vertical_wheel   = take(vertical_wheel);
+            report.horizontal_wheel = take(horizontal_wheel);
+            return post(report);
+        });
+    }
+
+    /*
+     * Posts as many reports as it takes to send the motion pending now,
+     * e.g. three for a delta of 300. Returns the first non-zero status, or
+     * 0 if every report went through.
+     */
+    template <typename Post>
+    int flush_all(Post post) {
+        int64_t largest = 0;
+        for (auto& value : motion) {
+            int64_t pending_motion = value.load(std::memory_order_relaxed);
+            largest = std::max(largest, pending_motion < 0 ? -pending_motion : pending_motion);
+        }
+        int result = 0;
+        // Motion added meanwhile may ride along but never extends the loop.
+        for (int64_t reports = std::max<int64_t>((largest + 126) / 127, 1); reports > 0; --reports) {
+            int status = flush(post);
+            if (result == 0) result = status;
+            if (!has_pending()) break;
+        }
+        return result;
+    }
+
+    // Drops pending motion and releases all buttons without posting.
+    void clear() {
+        for (auto& value : motion) value.store(0, std::memory_order_relaxed);
+        buttons.store(0, std::memory_order_release);
+        pending.store(false, std::memory_order_release);
+    }
+
+private:
+    // Removes up to one report's worth of motion from an axis.
+    int8_t take(axis a) {
+        int64_t available = motion[a].load(std::memory_order_relaxed);
+        int64_t step      = std::clamp<int64_t>(available, -127, 127);
+        if (step == 0) return 0;
+        // Concurrent add_motion() calls only change what is left behind.
+        motion[a].fetch_sub(step, std::memory_order_relaxed);
+        if (step != available) pending.store(true, std::memory_order_release);
+        return static_cast<int8_t>(step);
+    }
+
+    std::array<std::atomic<int64_t>, axis_count> motion{};
+    std::atomic<uint32_t> buttons{0};
+    std::atomic<bool> pending{false};
+    combining_poster poster;
+};
+
+/*
+ * Spaces reports at least `period` apart. The caller supplies the time, so
+ * a fake clock can drive it deterministically.
+ */
+template <typename Clock>
+class report_pacer {
+public:
+    using time_point = typename Clock::time_point;
+    using duration   = typename Clock::duration;
+
+    // Books a report at `now` if the previous one was at least `period` ago.
+    bool try_acquire(time_point now, duration period) {
+        if (now < next) return false;
+        next = now + period;
+        return true;
+    }
+
+    // Earliest time try_acquire() will succeed.
+    time_point next_slot() const { return next; }
+
+private:
+    time_point next{};
+};
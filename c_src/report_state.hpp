@@ -0,0 +1,259 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+
+/*
+ * Lock-free key state shared by every thread that calls send_key().
+ * Kept free of IOKit/pqrs includes so it can be built and exercised on
+ * any platform.
+ */
+
+/*
+ * Fixed-size bitmap of pressed usages for one usage page.
+ * Each word is an independent atomic, so concurrent set()/test() calls
+ * never need a lock. Usages >= capacity are not representable.
+ */
+template <size_t Bits = 1024>
+class atomic_key_bitmap {
+    static_assert(Bits % 64 == 0, "bitmap size must be a multiple of 64");
+public:
+    static constexpr size_t capacity = Bits;
+
+    // Returns true if the bit actually changed.
+    bool set(uint32_t code, bool down) {
+        uint64_t mask = uint64_t{1} << (code % 64);
+        auto& word    = words[code / 64];
+        uint64_t prev = down ? word.fetch_or(mask, std::memory_order_release)
+                             : word.fetch_and(~mask, std::memory_order_release);
+        return ((prev & mask) != 0) != down;
+    }
+
+    bool test(uint32_t code) const {
+        if (code >= capacity) return false;
+        return words[code / 64].load(std::memory_order_acquire) & (uint64_t{1} << (code % 64));
+    }
+
+    void clear() {
+        for (auto& word : words) word.store(0, std::memory_order_release);
+    }
+
+    // Calls f(code) for every pressed usage, in ascending order.
+    // Each word is read once, so the result is a per-word consistent snapshot.
+    template <typename Func>
+    void for_each(Func f) const {
+        for (size_t i = 0; i < words.size(); ++i) {
+            uint64_t word = words[i].load(std::memory_order_acquire);
+            while (word) {
+                unsigned bit = __builtin_ctzll(word);
+                f(static_cast<uint32_t>(i * 64 + bit));
+                word &= word - 1;
+            }
+        }
+    }
+
+private:
+    std::array<std::atomic<uint64_t>, Bits / 64> words{};
+};
+
+/*
+ * Lets any number of threads post a report built from shared atomic state
+ * without a lock. Every caller bumps `generation`; the thread that wins the
+ * `posting` flag builds and posts reports until it has covered every
+ * generation it can see, at most max_rounds times. Callers whose change was
+ * picked up by someone else's report wait for that report and return its
+ * status; if the flag holder gives up before reaching them, one of them
+ * takes the flag over. So every change is covered by a report posted after
+ * it, every caller learns whether that report went through, and no caller
+ * posts more than max_rounds reports.
+ */
+class combining_poster {
+public:
+    static constexpr int max_rounds = 4;
+
+    /*
+     * Call after changing the shared state. build_and_post() builds a
+     * report from the current state and returns the sink's status code.
+     * Returns the status of a report that included this change.
+     */
+    template <typename Func>
+    int post(Func build_and_post) {
+        uint64_t mine = generation.fetch_add(1, std::memory_order_acq_rel) + 1;
+        for (;;) {
+            if (posted.load(std::memory_order_acquire) >= mine)
+                return last_result.load(std::memory_order_relaxed);
+            if (posting.test_and_set(std::memory_order_acquire)) {
+                // Someone else is posting, most likely including our change.
+                std::this_thread::yield();
+                continue;
+            }
+            for (int round = 0; round < max_rounds; ++round) {
+                uint64_t seen = generation.load(std::memory_order_acquire);
+                if (posted.load(std::memory_order_relaxed) == seen) break;
+                last_result.store(build_and_post(), std::memory_order_relaxed);
+                posted.store(seen, std::memory_order_release);
+            }
+            posting.clear(std::memory_order_release);
+        }
+    }
+
+private:
+    std::atomic<uint64_t> generation{0};
+    std::atomic<uint64_t> posted{0};
+    std::atomic<int> last_result{0};
+    std::atomic_flag posting = ATOMIC_FLAG_INIT;
+};
+
+/*
+ * Pressed-key state and posting for one HID report type (keyboard,
+ * consumer, ...). Any number of threads may call update() concurrently:
+ * key state lives in an atomic bitmap and the report is rebuilt from it
+ * through a combining_poster.
+ */
+template <typename Report, size_t Bits = 1024>
+class report_channel {
+public:
+    /*
+     * Sets `code` to pressed/released and makes sure a report reflecting
+     * it gets posted. post(const Report&) returns the sink's status code.
+     * Returns 1 for unrepresentable usages, otherwise the status of the
+     * report that carried this change, whichever thread posted it.
+     */
+    template <typename Post>
+    int update(uint32_t code, bool down, Post post) {
+        if (code >= keys.capacity) return 1;
+        keys.set(code, down);
+        return poster.post([&] {
+            Report report;
+            keys.for_each([&report](uint32_t pressed) { report.keys.insert(pressed); });
+            return post(report);
+        });
+    }
+
+    // Clears all pressed keys without posting a report.
+    void clear() { keys.clear(); }
+
+    const atomic_key_bitmap<Bits>& state() const { return keys; }
+
+private:
+    atomic_key_bitmap<Bits> keys;
+    combining_poster poster;
+};
+
+/*
+ * HID usage pages that carry keyboard-style (pressed key set) reports.
+ * driverkit.cpp checks them against the pqrs usage_page values.
+ */
+namespace usage_pages {
+constexpr uint32_t generic_desktop       = 0x01;
+constexpr uint32_t keyboard_or_keypad    = 0x07;
+constexpr uint32_t button                = 0x09;
+constexpr uint32_t consumer              = 0x0C;
+constexpr uint32_t apple_vendor_top_case = 0xFF;
+constexpr uint32_t apple_vendor_keyboard = 0xFF01;
+}
+
+// Usage pages whose pressed-key state is tracked, per device and on output.
+constexpr std::array<uint32_t, 5> tracked_pages{
+    usage_pages::generic_desktop,
+    usage_pages::keyboard_or_keypad,
+    usage_pages::consumer,
+    usage_pages::apple_vendor_top_case,
+    usage_pages::apple_vendor_keyboard,
+};
+
+constexpr int tracked_page_index(uint32_t page) {
+    for (size_t i = 0; i < tracked_pages.size(); ++i)
+        if (tracked_pages[i] == page) return static_cast<int>(i);
+    return -1;
+}
+
+/*
+ * Pressed-key bitmaps for every tracked page of up to MaxDevices devices,
+ * keyed by device hash. Slots are claimed with a CAS and never given back,
+ * so lookups are a short open-addressing probe and every operation is
+ * lock-free and safe from any thread. Hash 0 is reserved for empty slots.
+ */
+template <size_t MaxDevices = 64, size_t Bits = 1024>
+class device_key_state {
+public:
+    using bitmap = atomic_key_bitmap<Bits>;
+
+    // Returns false if the device table is full or the usage isn't tracked.
+    bool set(uint64_t device_hash, uint32_t page, uint32_t code, bool down) {
+        int index = tracked_page_index(page);
+        if (index < 0 || code >= Bits) return false;
+        entry* found = claim(device_hash);
+        if (!found) return false;
+        found->pages[index].set(code, down);
+        return true;
+    }
+
+    bool test(uint64_t device_hash, uint32_t page, uint32_t code) const {
+        int index = tracked_page_index(page);
+        if (index < 0) return false;
+        const entry* found = lookup(device_hash);
+        return found && found->pages[index].test(code);
+    }
+
+    // Calls f(page, code) for every pressed usage of a device.
+    template <typename Func>
+    void for_each(uint64_t device_hash, Func f) const {
+        const entry* found = lookup(device_hash);
+        if (!found) return;
+        for (size_t i = 0; i < tracked_pages.size(); ++i)
+            found->pages[i].for_each([&](uint32_t code) { f(tracked_pages[i], code); });
+    }
+
+    // Releases every key of every device; claimed slots are kept.
+    void clear() {
+        for (auto& slot : entries)
+            for (auto& page : slot.pages) page.clear();
+    }
+
+    // Releases every key of one device, e.g. when it is captured again.
+    void clear(uint64_t device_hash) {
+        entry* found = lookup(device_hash);
+        if (!found) return;
+        for (auto& page : found->pages) page.clear();
+    }
+
+private:
+    struct entry {
+        std::atomic<uint64_t> hash{0};
+        std::array<bitmap, tracked_pages.size()> pages;
+    };
+
+    const entry* lookup(uint64_t device_hash) const {
+        if (device_hash == 0) return nullptr;
+        for (size_t i = 0; i < MaxDevices; ++i) {
+            const entry& slot = entries[(device_hash + i) % MaxDevices];
+            uint64_t current = slot.hash.load(std::memory_order_acquire);
+            if (current == device_hash) return &slot;
+            if (current == 0) return nullptr;
+        }
+        return nullptr;
+    }
+
+    entry* lookup(uint64_t device_hash) {
+        return const_cast<entry*>(static_cast<const device_key_state*>(this)->lookup(device_hash));
+    }
+
+    entry* claim(uint64_t device_hash) {
+        if (device_hash == 0) return nullptr;
+        for (size_t i = 0; i < MaxDevices; ++i) {
+            entry& slot = entries[(device_hash + i) % MaxDevices];
+            uint64_t current = slot.hash.load(std::memory_order_acquire);
+            if (current == 0 &&
+                slot.hash.compare_exchange_strong(current, device_hash, std::memory_order_acq_rel))
+                return &slot;
+            if (current == device_hash) return &slot;
+        }
+        return nullptr;
+    }
+
+    std::array<entry, MaxDevices> entries;
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+/*
+ * Bounded single-producer/single-consumer ring buffer. push() may only be
+ * called from one thread and pop()/front() from one (other) thread; both
+ * sides are wait-free. Capacity must be a power of two.
+ */
+template <typename T, size_t Capacity>
+class spsc_queue {
+    static_assert(Capacity && (Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+public:
+    // Returns false if the queue is full.
+    bool push(const T& item) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == Capacity) return false;
+        slots[t % Capacity] = item;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Producer side: true if push() would fail right now.
+    bool full() const {
+        return tail.load(std::memory_order_relaxed) - head.load(std::memory_order_acquire) == Capacity;
+    }
+
+    // Returns false if the queue is empty.
+    bool pop(T& item) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) return false;
+        item = slots[h % Capacity];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Oldest item without removing it, or nullptr if the queue is empty.
+    const T* front() const {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) return nullptr;
+        return &slots[h % Capacity];
+    }
+
+private:
+    std::array<T, Capacity> slots{};
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+};
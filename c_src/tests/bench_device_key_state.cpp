@@ -0,0 +1,69 @@
+#include <chrono>
+#include <cstdio>
+#include <vector>
+#include "check.hpp"
+#include "report_state.hpp"
+
+/*
+ * Cost of the pressed-key table: set() is what input_callback() adds to
+ * every captured event, test() and for_each() are is_key_down() and
+ * get_pressed_keys(). Measured with 1, 8 and 64 registered devices, since
+ * lookups probe the open-addressing table.
+ */
+
+namespace {
+
+constexpr int iterations = 2000000;
+
+// Keeps the optimizer from dropping a result.
+volatile uint64_t sink;
+
+template <typename Func>
+double ns_per_op(int ops, Func f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / ops;
+}
+
+uint64_t device_hash(int i) { return 0x9E3779B97F4A7C15ull * (i + 1); }
+
+void run(int devices) {
+    static device_key_state<> state;
+    state.clear();
+    std::vector<uint64_t> hashes;
+    for (int i = 0; i < devices; ++i) {
+        hashes.push_back(device_hash(i));
+        state.set(hashes.back(), usage_pages::keyboard_or_keypad, 0x04, true);
+    }
+
+    double set = ns_per_op(iterations, [&] {
+        for (int i = 0; i < iterations; ++i)
+            state.set(hashes[i % devices], usage_pages::keyboard_or_keypad, 0x04 + i % 32, i & 1);
+    });
+    double test_hit = ns_per_op(iterations, [&] {
+        uint64_t down = 0;
+        for (int i = 0; i < iterations; ++i)
+            down += state.test(hashes[i % devices], usage_pages::keyboard_or_keypad, 0x04 + i % 32);
+        sink = down;
+    });
+    double test_miss = ns_per_op(iterations, [&] {
+        uint64_t down = 0;
+        for (int i = 0; i < iterations; ++i)
+            down += state.test(device_hash(1000 + i % 16), usage_pages::keyboard_or_keypad, 0x04);
+        sink = down;
+    });
+    double snapshot = ns_per_op(iterations / 100, [&] {
+        uint64_t count = 0;
+        for (int i = 0; i < iterations / 100; ++i)
+            state.for_each(hashes[i % devices], [&](uint32_t, uint32_t) { ++count; });
+        sink = count;
+    });
+    std::printf("%7d %10.1f %12.1f %13.1f %13.1f\n", devices, set, test_hit, test_miss, snapshot);
+}
+
+} // namespace
+
+int main() {
+    std::printf("%7s %10s %12s %13s %13s   (ns/op)\n", "devices", "set", "test (hit)", "test (miss)", "for_each");
+    for (int devices : {1, 8, 64}) run(devices);
+}
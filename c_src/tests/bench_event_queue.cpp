@@ -0,0 +1,63 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+#include "check.hpp"
+#include "event_queue.hpp"
+
+/*
+ * Input throughput against listener shard count. 16 simulated devices
+ * are spread over the shards by index % shards, as driverkit does by
+ * hash. Each event costs its shard ~2 us of dispatch (run loop, IOHIDValue
+ * decoding, input_callback), then goes through the sequenced_event_queue
+ * to one consumer, which stands in for wait_key().
+ */
+
+namespace {
+
+constexpr uint32_t devices           = 16;
+constexpr uint32_t events_per_device = 4000;
+constexpr uint64_t dispatch_cost_ns  = 2000;
+
+struct event {
+    uint32_t device;
+    uint32_t index;
+};
+
+void run(uint32_t shards) {
+    sequenced_event_queue<event> queue(shards);
+    queue.open_lanes(shards);
+    std::atomic<bool> go{false};
+    std::vector<std::thread> threads;
+    for (uint32_t shard = 0; shard < shards; ++shard) {
+        threads.emplace_back([&, shard] {
+            while (!go.load(std::memory_order_acquire)) std::this_thread::yield();
+            // Round-robin over this shard's devices, as their events interleave.
+            for (uint32_t i = 0; i < events_per_device; ++i)
+                for (uint32_t device = shard; device < devices; device += shards) {
+                    spin_for(dispatch_cost_ns);
+                    queue.push(shard, {device, i});
+                }
+        });
+    }
+
+    uint64_t total = uint64_t(devices) * events_per_device, received = 0;
+    auto start = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    for (event e; received < total;) {
+        if (queue.try_pop(e)) ++received;
+        else std::this_thread::yield();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    for (auto& t : threads) t.join();
+    std::printf("%6u %14.0f\n", shards, total / seconds);
+}
+
+} // namespace
+
+int main() {
+    std::printf("hardware threads: %u\n", std::thread::hardware_concurrency());
+    std::printf("%6s %14s\n", "shards", "events/s");
+    for (uint32_t shards : {1u, 2u, 4u, 8u}) run(shards);
+}
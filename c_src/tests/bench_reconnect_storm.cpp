@@ -0,0 +1,110 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+#include "device_settle.hpp"
+#include "spsc_queue.hpp"
+
+namespace {
+
+constexpr double settle_delay = 0.05;
+
+/*
+ * A reconnect storm against a simulated device layer whose open takes
+ * open_delay (like a seizing IOHIDDeviceOpen of a Bluetooth keyboard).
+ * Three devices each send a burst of matched notifications, twice. Input
+ * events arrive every 500 us and the listener records how long each one
+ * waited. With device_thread_split the notifications and opens run on
+ * their own thread as in driverkit.cpp; otherwise they run on the
+ * listener, as they did before.
+ */
+constexpr auto open_delay = std::chrono::milliseconds(30);
+
+struct storm_result {
+    double max_latency_ms = 0;
+    size_t opens = 0;
+    size_t adopted = 0;
+};
+
+using clock_type = std::chrono::steady_clock;
+
+double seconds_since(clock_type::time_point start) {
+    return std::chrono::duration<double>(clock_type::now() - start).count();
+}
+
+storm_result run_storm(bool device_thread_split) {
+    const auto start = clock_type::now();
+    std::vector<std::pair<double, uint64_t>> notifications;
+    for (double burst : {0.02, 0.15})
+        for (double t = burst; t < burst + 0.06; t += 0.004)
+            for (uint64_t device = 1; device <= 3; ++device) notifications.emplace_back(t, device);
+
+    settle_queue<int> pending(settle_delay);
+    spsc_queue<uint64_t, 64> handoff;
+    spsc_queue<clock_type::time_point, 4096> events;
+    std::atomic<bool> devices_done{false}, input_done{false};
+    storm_result result;
+    size_t next_notification = 0;
+
+    // One turn of device_thread's run loop: notifications, then the settle timer.
+    auto device_step = [&] {
+        double now = seconds_since(start);
+        for (; next_notification < notifications.size() && notifications[next_notification].first <= now;
+             ++next_notification)
+            pending.add(notifications[next_notification].second, 0, now);
+        result.opens += pending.drain(now, [&](uint64_t hash, int) {
+            std::this_thread::sleep_for(open_delay);
+            while (!handoff.push(hash)) std::this_thread::yield();
+        });
+        if (next_notification == notifications.size() && pending.size() == 0) devices_done = true;
+    };
+
+    std::thread producer([&] {
+        while (!devices_done) {
+            while (!events.push(clock_type::now())) std::this_thread::yield();
+            std::this_thread::sleep_for(std::chrono::microseconds(500));
+        }
+        input_done = true;
+    });
+    std::thread device_thread;
+    if (device_thread_split) {
+        device_thread = std::thread([&] {
+            while (!devices_done) {
+                device_step();
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        });
+    }
+
+    // The listener: drains input and adopts opened devices.
+    for (;;) {
+        bool idle = true;
+        for (clock_type::time_point stamp; events.pop(stamp); idle = false) {
+            double latency = std::chrono::duration<double, std::milli>(clock_type::now() - stamp).count();
+            result.max_latency_ms = std::max(result.max_latency_ms, latency);
+        }
+        for (uint64_t hash; handoff.pop(hash); idle = false) ++result.adopted;
+        if (!device_thread_split && !devices_done) device_step();
+        if (input_done && idle && !events.front()) break;
+        if (idle) std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    producer.join();
+    if (device_thread.joinable()) device_thread.join();
+    for (uint64_t hash; handoff.pop(hash);) ++result.adopted;
+    return result;
+}
+
+
+} // namespace
+
+int main() {
+    std::printf("hardware threads: %u\n", std::thread::hardware_concurrency());
+    std::printf("%-22s %16s %6s\n", "opens run on", "max latency (ms)", "opens");
+    for (bool split : {false, true}) {
+        storm_result result = run_storm(split);
+        std::printf("%-22s %16.2f %6zu\n", split ? "device_thread" : "listener loop", result.max_latency_ms,
+                    result.opens);
+    }
+}
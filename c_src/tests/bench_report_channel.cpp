@@ -0,0 +1,56 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <set>
+#include <thread>
+#include <vector>
+#include "check.hpp"
+#include "report_state.hpp"
+
+/*
+ * send_key() throughput against a mock sink that costs about as much as a
+ * kext IOConnectCall (~2 us), for 1..8 producer threads. Reports how many
+ * updates were folded into each posted report.
+ */
+
+namespace {
+
+struct mock_report {
+    std::set<uint32_t> keys;
+};
+
+constexpr uint64_t sink_cost_ns = 2000;
+constexpr int updates_per_thread = 20000;
+
+void run(int producers) {
+    report_channel<mock_report> channel;
+    std::atomic<uint64_t> posts{0};
+    auto post = [&](const mock_report&) {
+        spin_for(sink_cost_ns);
+        posts.fetch_add(1, std::memory_order_relaxed);
+        return 0;
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; ++p) {
+        threads.emplace_back([&, p] {
+            for (int i = 0; i < updates_per_thread; ++i)
+                channel.update(p * 8 + i % 8, i % 2 == 0, post);
+        });
+    }
+    for (auto& t : threads) t.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    uint64_t updates = uint64_t(producers) * updates_per_thread;
+    std::printf("%9d %14.0f %12llu %14.2f\n", producers, updates / seconds,
+                static_cast<unsigned long long>(posts.load()), double(updates) / posts.load());
+}
+
+} // namespace
+
+int main() {
+    std::printf("hardware threads: %u\n", std::thread::hardware_concurrency());
+    std::printf("%9s %14s %12s %14s\n", "producers", "updates/s", "reports", "updates/report");
+    for (int producers : {1, 2, 4, 8}) run(producers);
+}
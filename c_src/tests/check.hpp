@@ -0,0 +1,31 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+/*
+ * Minimal assertion helpers for the header tests: CHECK() reports and
+ * counts failures instead of aborting, so one run shows all of them.
+ * A test's main() ends with `return check_result();`.
+ */
+inline int check_failures = 0;
+
+#define CHECK(cond)                                                                 \
+    do {                                                                            \
+        if (!(cond)) {                                                              \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+            ++check_failures;                                                       \
+        }                                                                           \
+    } while (0)
+
+inline int check_result() {
+    if (check_failures) std::fprintf(stderr, "%d check(s) failed\n", check_failures);
+    return check_failures ? 1 : 0;
+}
+
+// Busy-waits for `ns` nanoseconds; stands in for the cost of a sink call.
+inline void spin_for(uint64_t ns) {
+    auto until = std::chrono::steady_clock::now() + std::chrono::nanoseconds(ns);
+    while (std::chrono::steady_clock::now() < until) {}
+}
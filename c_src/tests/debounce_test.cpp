@@ -0,0 +1,144 @@
+#include <vector>
+#include "check.hpp"
+#include "debounce.hpp"
+
+/*
+ * Replays recorded key edges through debounce_engine. Times are in ms
+ * (the window is 5 ms) and converted to the engine's nanoseconds.
+ */
+
+namespace {
+
+constexpr uint32_t page   = 0x07;
+constexpr uint64_t window = 5;
+
+struct edge {
+    uint32_t code;
+    bool down;
+    uint64_t ms;
+
+    bool operator==(const edge& other) const {
+        return code == other.code && down == other.down && ms == other.ms;
+    }
+};
+
+uint64_t ns(uint64_t ms) { return ms * 1000000; }
+
+/*
+ * Feeds `trace` to the engine the way the listener does: a run-loop timer
+ * armed for next_deadline() calls poll() when it fires, and input() is
+ * called for every captured value. Returns everything emitted.
+ */
+std::vector<edge> replay(debounce_engine& engine, const std::vector<edge>& trace) {
+    std::vector<edge> out;
+    auto emit = [&](uint32_t, uint32_t code, bool down, uint64_t timestamp) {
+        out.push_back({ code, down, timestamp / 1000000 });
+    };
+    for (const edge& e : trace) {
+        while (engine.next_deadline() <= ns(e.ms)) engine.poll(engine.next_deadline(), emit);
+        engine.input(page, e.code, e.down, ns(e.ms), emit);
+    }
+    while (engine.next_deadline() != UINT64_MAX) engine.poll(engine.next_deadline(), emit);
+    return out;
+}
+
+void test_none() {
+    debounce_engine engine(debounce_algorithm::none, ns(window));
+    std::vector<edge> trace{{4, true, 0}, {4, false, 1}, {4, true, 2}};
+    CHECK(replay(engine, trace) == trace);
+    CHECK(engine.suppressed() == 0);
+}
+
+void test_eager_chatter() {
+    debounce_engine engine(debounce_algorithm::eager, ns(window));
+    // Press passes at once; the release/press bounce 2 ms later is dropped
+    // as a pair, and the real release after the window passes untouched.
+    auto out = replay(engine, {{4, true, 0}, {4, false, 2}, {4, true, 3}, {4, false, 20}});
+    CHECK(out == (std::vector<edge>{{4, true, 0}, {4, false, 20}}));
+    CHECK(engine.suppressed() == 2);
+}
+
+void test_eager_held_edge() {
+    debounce_engine engine(debounce_algorithm::eager, ns(window));
+    std::vector<edge> out;
+    auto emit = [&](uint32_t, uint32_t code, bool down, uint64_t t) { out.push_back({ code, down, t / 1000000 }); };
+
+    engine.input(page, 4, true, ns(0), emit);
+    engine.input(page, 4, false, ns(2), emit);
+    // A real quick tap: the release is held until the window closes.
+    CHECK(engine.next_deadline() == ns(5));
+    engine.poll(ns(4), emit);
+    CHECK(out == (std::vector<edge>{{4, true, 0}}));
+    engine.poll(ns(5), emit);
+    CHECK(out == (std::vector<edge>{{4, true, 0}, {4, false, 5}}));
+    CHECK(engine.next_deadline() == UINT64_MAX);
+    CHECK(engine.suppressed() == 0);
+}
+
+void test_eager_keeps_order() {
+    debounce_engine engine(debounce_algorithm::eager, ns(window));
+    std::vector<edge> out;
+    auto emit = [&](uint32_t, uint32_t code, bool down, uint64_t t) { out.push_back({ code, down, t / 1000000 }); };
+
+    // Without a timer firing, a later input flushes the expired held edge first.
+    engine.input(page, 4, true, ns(0), emit);
+    engine.input(page, 4, false, ns(2), emit);
+    engine.input(page, 5, true, ns(10), emit);
+    CHECK(out == (std::vector<edge>{{4, true, 0}, {4, false, 5}, {5, true, 10}}));
+}
+
+void test_deferred_chatter() {
+    debounce_engine engine(debounce_algorithm::deferred, ns(window));
+    // A press that bounces back within the window is never reported; a
+    // bounce restarts the wait, so the second press only passes at 15.
+    auto out = replay(engine, {{4, true, 0}, {4, false, 3}, {4, true, 10}, {4, false, 30}});
+    CHECK(out == (std::vector<edge>{{4, true, 15}, {4, false, 35}}));
+    CHECK(engine.suppressed() == 2);
+}
+
+void test_deferred_independent_keys() {
+    debounce_engine engine(debounce_algorithm::deferred, ns(window));
+    auto out = replay(engine, {{4, true, 0}, {5, true, 1}, {5, false, 2}, {5, true, 3}, {4, false, 9}});
+    CHECK(out == (std::vector<edge>{{4, true, 5}, {5, true, 8}, {4, false, 14}}));
+    CHECK(engine.suppressed() == 2);
+}
+
+void test_suppressed_count() {
+    debounce_engine engine(debounce_algorithm::eager, ns(window));
+    std::vector<edge> trace{{4, true, 0}};
+    // Ten bounce pairs inside the window of a single press.
+    for (uint64_t i = 0; i < 10; ++i) {
+        trace.push_back({4, false, 1});
+        trace.push_back({4, true, 1});
+    }
+    auto out = replay(engine, trace);
+    CHECK(out == (std::vector<edge>{{4, true, 0}}));
+    CHECK(engine.suppressed() == 20);
+
+    // reset() drops held edges but keeps the count.
+    engine.input(page, 4, false, ns(2), [](uint32_t, uint32_t, bool, uint64_t) {});
+    CHECK(engine.next_deadline() == ns(5));
+    engine.reset();
+    CHECK(engine.next_deadline() == UINT64_MAX);
+    CHECK(engine.suppressed() == 20);
+}
+
+void test_repeats_pass_through() {
+    debounce_engine engine(debounce_algorithm::eager, ns(window));
+    auto out = replay(engine, {{4, true, 0}, {4, true, 1}, {4, false, 10}, {4, false, 11}});
+    CHECK(out == (std::vector<edge>{{4, true, 0}, {4, true, 1}, {4, false, 10}, {4, false, 11}}));
+}
+
+} // namespace
+
+int main() {
+    test_none();
+    test_eager_chatter();
+    test_eager_held_edge();
+    test_eager_keeps_order();
+    test_deferred_chatter();
+    test_deferred_independent_keys();
+    test_suppressed_count();
+    test_repeats_pass_through();
+    return check_result();
+}
@@ -0,0 +1,106 @@
+#include <algorithm>
+#include <limits>
+#include <vector>
+#include "check.hpp"
+#include "device_settle.hpp"
+
+namespace {
+
+constexpr double settle_delay = 0.05;
+
+struct opened {
+    uint64_t hash;
+    int service;
+
+    bool operator==(const opened& other) const { return hash == other.hash && service == other.service; }
+};
+
+void test_coalescing() {
+    settle_queue<int> queue(settle_delay);
+    std::vector<opened> out;
+    auto open = [&](uint64_t hash, int service) { out.push_back({ hash, service }); };
+
+    CHECK(queue.deadline() == std::numeric_limits<double>::infinity());
+    CHECK(!queue.add(1, 10, 0.00));
+    // A repeated match replaces the older one, which is handed back, and
+    // pushes that device's deadline back.
+    CHECK(queue.add(1, 11, 0.01) == 10);
+    CHECK(!queue.add(2, 20, 0.02));
+    CHECK(queue.size() == 2);
+    CHECK(queue.deadline() == 0.01 + settle_delay);
+
+    CHECK(queue.drain(0.05, open) == 0);
+    CHECK(out.empty());
+    // Each device settles on its own deadline.
+    CHECK(queue.drain(0.01 + settle_delay, open) == 1);
+    CHECK(out == (std::vector<opened>{{1, 11}}));
+    CHECK(queue.deadline() == 0.02 + settle_delay);
+    CHECK(queue.drain(0.02 + settle_delay, open) == 1);
+    CHECK(out == (std::vector<opened>{{1, 11}, {2, 20}}));
+    CHECK(queue.size() == 0);
+    CHECK(queue.deadline() == std::numeric_limits<double>::infinity());
+
+    // clear() hands every pending match to release().
+    std::vector<int> released;
+    queue.add(3, 30, 1.0);
+    queue.add(4, 40, 1.0);
+    queue.clear([&](int service) { released.push_back(service); });
+    CHECK(released.size() == 2);
+    CHECK(queue.drain(10.0, open) == 0);
+}
+
+/*
+ * Drives a settle_queue with a fake clock in 1 ms steps, the way
+ * device_thread does: every matched notification due by then is added,
+ * then whatever settled is opened. Returns when each device was opened.
+ */
+std::vector<std::pair<double, uint64_t>> settle(const std::vector<std::pair<double, uint64_t>>& notifications,
+                                                double until) {
+    settle_queue<int> queue(settle_delay);
+    std::vector<std::pair<double, uint64_t>> opens;
+    size_t next = 0;
+    for (int step = 0; step <= int(until * 1000); ++step) {
+        double now = step / 1000.0;
+        for (; next < notifications.size() && notifications[next].first <= now; ++next)
+            queue.add(notifications[next].second, 0, now);
+        queue.drain(now, [&](uint64_t hash, int) { opens.emplace_back(now, hash); });
+    }
+    return opens;
+}
+
+// Three devices send two bursts of 15 matches each; each burst opens each device once.
+void test_reconnect_storm() {
+    std::vector<std::pair<double, uint64_t>> notifications;
+    for (double burst : {0.02, 0.15})
+        for (int i = 0; i < 15; ++i)
+            for (uint64_t device = 1; device <= 3; ++device)
+                notifications.emplace_back(burst + i * 0.004, device);
+
+    auto opens = settle(notifications, 0.5);
+    CHECK(opens.size() == 6);
+    for (uint64_t device = 1; device <= 3; ++device)
+        CHECK(std::count_if(opens.begin(), opens.end(), [&](auto& o) { return o.second == device; }) == 2);
+}
+
+// A device re-matching every 20 ms must not delay another device's capture.
+void test_flapping_device() {
+    std::vector<std::pair<double, uint64_t>> notifications;
+    for (int i = 0; i <= 50; ++i) {
+        notifications.emplace_back(i * 0.02, 1);
+        if (i == 5) notifications.emplace_back(0.1, 2);
+    }
+
+    auto opens = settle(notifications, 1.2);
+    CHECK(opens.size() == 2);
+    CHECK(opens.size() == 2 && opens[0].second == 2 && opens[0].first <= 0.1 + settle_delay + 0.001);
+    CHECK(opens.size() == 2 && opens[1].second == 1 && opens[1].first >= 1.0 + settle_delay - 0.001);
+}
+
+} // namespace
+
+int main() {
+    test_coalescing();
+    test_reconnect_storm();
+    test_flapping_device();
+    return check_result();
+}
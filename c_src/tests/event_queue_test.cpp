@@ -0,0 +1,184 @@
+#include <poll.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "check.hpp"
+#include "event_queue.hpp"
+
+namespace {
+
+struct event {
+    uint32_t lane;
+    uint32_t index;
+};
+
+void test_single_thread_order() {
+    sequenced_event_queue<event, 8> queue(3);
+    queue.open_lanes(3);
+    event e;
+    CHECK(!queue.try_pop(e));
+    queue.push(2, {2, 0});
+    queue.push(0, {0, 0});
+    queue.push(2, {2, 1});
+    queue.push(1, {1, 0});
+
+    std::vector<uint32_t> lanes;
+    while (queue.try_pop(e)) lanes.push_back(e.lane);
+    CHECK(lanes == (std::vector<uint32_t>{2, 0, 2, 1}));
+}
+
+void test_discard_pending() {
+    sequenced_event_queue<event, 8> queue(2);
+    queue.open_lanes(2);
+    queue.push(0, {0, 0});
+    queue.push(1, {1, 0});
+    event e;
+    CHECK(queue.try_pop(e) && e.lane == 0);
+    // The producers stop with one event left; the next session starts clean.
+    queue.discard_pending();
+    queue.push(1, {1, 1});
+    queue.push(0, {0, 1});
+    CHECK(queue.try_pop(e) && e.lane == 1 && e.index == 1);
+    CHECK(queue.try_pop(e) && e.lane == 0 && e.index == 1);
+    CHECK(!queue.try_pop(e));
+}
+
+void test_open_lanes() {
+    sequenced_event_queue<event, 8> queue(4);
+    CHECK(queue.size() == 0);
+    queue.open_lanes(2);
+    CHECK(queue.size() == 2);
+    queue.push(1, {1, 0});
+    // Opening more lanes later keeps what is queued; lanes are never freed.
+    queue.open_lanes(8);
+    CHECK(queue.size() == 4);
+    queue.push(3, {3, 0});
+    queue.open_lanes(1);
+    CHECK(queue.size() == 4);
+    event e;
+    CHECK(queue.try_pop(e) && e.lane == 1);
+    CHECK(queue.try_pop(e) && e.lane == 3);
+}
+
+/*
+ * A producer stuck on a full lane (the consumer stopped reading) must give
+ * up once stop_producers() is called, without leaving a sequence gap.
+ */
+void test_stop_full_lane() {
+    sequenced_event_queue<event, 4> queue(1);
+    queue.open_lanes(1);
+    std::atomic<int> dropped{0};
+    std::thread producer([&] {
+        for (uint32_t i = 0; i < 6; ++i)
+            if (!queue.push(0, {0, i}) && i >= 4) dropped.fetch_add(1);
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    queue.stop_producers();
+    producer.join();
+    CHECK(dropped == 2);
+
+    queue.discard_pending();
+    event e;
+    CHECK(!queue.try_pop(e));
+    queue.open_lanes(1);
+    queue.push(0, {0, 100});
+    CHECK(queue.try_pop(e) && e.index == 100);
+}
+
+/*
+ * Producers take turns through a shared counter, so each push happens
+ * after the previous one on another lane. The consumer must see the turns
+ * in order, i.e. merging lanes preserves cross-thread ordering.
+ */
+void test_cross_lane_order(uint32_t lanes, uint32_t turns) {
+    sequenced_event_queue<event, 64> queue(lanes);
+    queue.open_lanes(lanes);
+    std::atomic<uint32_t> turn{0};
+    std::vector<std::thread> producers;
+    for (uint32_t lane = 0; lane < lanes; ++lane) {
+        producers.emplace_back([&, lane] {
+            for (;;) {
+                uint32_t current = turn.load(std::memory_order_acquire);
+                if (current >= turns) return;
+                if (current % lanes != lane) { std::this_thread::yield(); continue; }
+                queue.push(lane, {lane, current});
+                turn.store(current + 1, std::memory_order_release);
+            }
+        });
+    }
+    uint32_t next = 0, out_of_order = 0;
+    for (event e; next < turns;) {
+        if (!queue.try_pop(e)) { std::this_thread::yield(); continue; }
+        if (e.index != next || e.lane != next % lanes) ++out_of_order;
+        ++next;
+    }
+    for (auto& t : producers) t.join();
+    CHECK(out_of_order == 0);
+}
+
+/*
+ * Free-running producers and a consumer that sleeps on a pipe doorbell
+ * exactly like wait_key(). Every event must arrive, in per-lane order,
+ * and the consumer must never sleep through a push (a lost wake-up shows
+ * up as a poll() timeout).
+ */
+void test_doorbell(uint32_t lanes, uint32_t per_lane) {
+    sequenced_event_queue<event, 128> queue(lanes);
+    queue.open_lanes(lanes);
+    int bell[2];
+    CHECK(pipe(bell) == 0);
+
+    std::atomic<uint32_t> failed_writes{0};
+    std::vector<std::thread> producers;
+    for (uint32_t lane = 0; lane < lanes; ++lane) {
+        producers.emplace_back([&, lane] {
+            for (uint32_t i = 0; i < per_lane; ++i) {
+                if (queue.push(lane, {lane, i})) {
+                    char byte = 0;
+                    if (write(bell[1], &byte, 1) != 1) failed_writes.fetch_add(1);
+                }
+                if (i % 64 == 0) std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+        });
+    }
+
+    std::vector<uint32_t> next(lanes, 0);
+    uint32_t received = 0, out_of_order = 0, timeouts = 0;
+    auto take = [&](const event& e) {
+        if (e.index != next[e.lane]) ++out_of_order;
+        next[e.lane] = e.index + 1;
+        ++received;
+    };
+    while (received < lanes * per_lane && timeouts == 0) {
+        event e;
+        if (queue.try_pop(e)) { take(e); continue; }
+        queue.prepare_wait();
+        if (queue.try_pop(e)) { take(e); continue; }
+        pollfd waiter{ bell[0], POLLIN, 0 };
+        if (poll(&waiter, 1, 2000) != 1) { ++timeouts; break; }
+        char byte;
+        CHECK(read(bell[0], &byte, 1) == 1);
+    }
+    for (auto& t : producers) t.join();
+    close(bell[0]);
+    close(bell[1]);
+
+    CHECK(failed_writes == 0);
+    CHECK(timeouts == 0);
+    CHECK(received == lanes * per_lane);
+    CHECK(out_of_order == 0);
+}
+
+} // namespace
+
+int main() {
+    test_single_thread_order();
+    test_discard_pending();
+    test_open_lanes();
+    test_stop_full_lane();
+    test_cross_lane_order(4, 2000);
+    for (uint32_t lanes : {1u, 3u, 8u}) test_doorbell(lanes, 5000);
+    return check_result();
+}
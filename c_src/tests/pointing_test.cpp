@@ -0,0 +1,178 @@
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "check.hpp"
+#include "pointing.hpp"
+
+namespace {
+
+struct mock_pointing_report {
+    struct {
+        uint32_t bits = 0;
+        void insert(uint32_t button) { bits |= uint32_t{1} << (button - 1); }
+    } buttons;
+    int8_t x = 0;
+    int8_t y = 0;
+    int8_t vertical_wheel = 0;
+    int8_t horizontal_wheel = 0;
+};
+
+using channel_type = pointer_channel<mock_pointing_report>;
+using axis         = channel_type::axis;
+
+// Collects every posted report; the sink is only ever entered by one thread.
+struct mock_sink {
+    std::vector<mock_pointing_report> reports;
+    int status = 0;
+
+    auto poster() {
+        return [this](const mock_pointing_report& report) {
+            reports.push_back(report);
+            return status;
+        };
+    }
+};
+
+// Time only moves when the test says so.
+struct fake_clock {
+    using duration   = std::chrono::nanoseconds;
+    using time_point = std::chrono::time_point<fake_clock, duration>;
+};
+
+void test_coalescing() {
+    channel_type channel;
+    mock_sink sink;
+    // Only the first delta after a flush asks for the flusher to be woken.
+    CHECK(channel.add_motion(axis::x, 1));
+    for (int i = 0; i < 99; ++i) CHECK(!channel.add_motion(axis::x, 1));
+    channel.add_motion(axis::vertical_wheel, -3);
+    CHECK(channel.has_pending());
+    CHECK(sink.reports.empty());
+
+    CHECK(channel.flush(sink.poster()) == 0);
+    CHECK(sink.reports.size() == 1);
+    CHECK(sink.reports[0].x == 100);
+    CHECK(sink.reports[0].vertical_wheel == -3);
+    CHECK(!channel.has_pending());
+    CHECK(channel.add_motion(axis::y, 1));
+}
+
+void test_split_large_motion() {
+    channel_type channel;
+    mock_sink sink;
+    channel.add_motion(axis::x, 300);
+    channel.add_motion(axis::y, -200);
+
+    channel.flush(sink.poster());
+    CHECK(sink.reports.back().x == 127 && sink.reports.back().y == -127);
+    CHECK(channel.has_pending());
+    channel.flush(sink.poster());
+    CHECK(sink.reports.back().x == 127 && sink.reports.back().y == -73);
+    channel.flush(sink.poster());
+    CHECK(sink.reports.back().x == 46 && sink.reports.back().y == 0);
+    CHECK(!channel.has_pending());
+
+    // flush_all() sends everything in one call, as rate 0 does.
+    sink.reports.clear();
+    channel.add_motion(axis::horizontal_wheel, -1000);
+    sink.status = 5;
+    CHECK(channel.flush_all(sink.poster()) == 5);
+    CHECK(sink.reports.size() == 8);
+    int total = 0;
+    for (auto& report : sink.reports) total += report.horizontal_wheel;
+    CHECK(total == -1000);
+    CHECK(!channel.has_pending());
+}
+
+void test_buttons_post_immediately() {
+    channel_type channel;
+    mock_sink sink;
+    channel.add_motion(axis::x, 5);
+    CHECK(channel.update_button(1, true, sink.poster()) == 0);
+    CHECK(sink.reports.size() == 1);
+    CHECK(sink.reports[0].buttons.bits == 0x1);
+    // The report carries the motion pending at the time.
+    CHECK(sink.reports[0].x == 5);
+
+    CHECK(channel.update_button(32, true, sink.poster()) == 0);
+    CHECK(sink.reports.back().buttons.bits == 0x80000001);
+    CHECK(channel.update_button(1, false, sink.poster()) == 0);
+    CHECK(sink.reports.back().buttons.bits == 0x80000000);
+    CHECK(sink.reports.size() == 3);
+
+    CHECK(channel.update_button(0, true, sink.poster()) == 1);
+    CHECK(channel.update_button(33, true, sink.poster()) == 1);
+    CHECK(sink.reports.size() == 3);
+
+    channel.clear();
+    channel.flush(sink.poster());
+    CHECK(sink.reports.back().buttons.bits == 0);
+}
+
+/*
+ * One second of motion events every 100 us, flushed the way the pointing
+ * thread does: whenever motion is pending and the pacer has a slot.
+ */
+void test_pacing(uint32_t rate) {
+    channel_type channel;
+    mock_sink sink;
+    report_pacer<fake_clock> pacer;
+    const auto period = std::chrono::microseconds(1000000 / rate);
+    const int events  = 10000;
+
+    for (int i = 0; i < events; ++i) {
+        fake_clock::time_point now{std::chrono::microseconds(100 * i)};
+        channel.add_motion(axis::x, 1);
+        if (channel.has_pending() && pacer.try_acquire(now, period)) channel.flush(sink.poster());
+    }
+    size_t paced = sink.reports.size();
+    channel.flush_all(sink.poster());
+
+    int total = 0;
+    for (auto& report : sink.reports) total += report.x;
+    CHECK(paced == rate);
+    CHECK(total == events);
+}
+
+// Concurrent producers and a flusher; no motion may get lost.
+void test_concurrent_motion() {
+    channel_type channel;
+    std::mutex mutex;
+    int64_t total = 0;
+    std::atomic<bool> done{false};
+    auto post = [&](const mock_pointing_report& report) {
+        std::lock_guard<std::mutex> lock(mutex);
+        total += report.x;
+        return 0;
+    };
+
+    std::thread flusher([&] {
+        while (!done.load()) {
+            if (channel.has_pending()) channel.flush(post);
+            else std::this_thread::yield();
+        }
+    });
+    std::vector<std::thread> producers;
+    for (int p = 0; p < 4; ++p)
+        producers.emplace_back([&] {
+            for (int i = 0; i < 20000; ++i) channel.add_motion(axis::x, 3);
+        });
+    for (auto& t : producers) t.join();
+    done = true;
+    flusher.join();
+    channel.flush_all(post);
+    CHECK(total == 4 * 20000 * 3);
+}
+
+} // namespace
+
+int main() {
+    test_coalescing();
+    test_split_large_motion();
+    test_buttons_post_immediately();
+    for (uint32_t rate : {125u, 250u, 1000u}) test_pacing(rate);
+    test_concurrent_motion();
+    return check_result();
+}
@@ -0,0 +1,155 @@
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+#include "check.hpp"
+#include "report_state.hpp"
+
+namespace {
+
+struct mock_report {
+    std::set<uint32_t> keys;
+};
+
+/*
+ * Records every posted report and fails the test if the sink is ever
+ * entered by two threads at once.
+ */
+struct mock_sink {
+    std::atomic<int> inside{0};
+    std::atomic<int> overlaps{0};
+    std::atomic<uint64_t> posts{0};
+    std::atomic<int> status{0};
+    std::mutex mutex;
+    mock_report last;
+
+    int operator()(const mock_report& report) {
+        if (inside.fetch_add(1) != 0) overlaps.fetch_add(1);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            last = report;
+        }
+        posts.fetch_add(1);
+        inside.fetch_sub(1);
+        return status.load();
+    }
+};
+
+thread_local int posts_by_this_call = 0;
+
+void test_single_thread() {
+    report_channel<mock_report> channel;
+    mock_sink sink;
+    auto post = [&](const mock_report& r) { return sink(r); };
+
+    CHECK(channel.update(0x04, true, post) == 0);
+    CHECK(sink.last.keys == std::set<uint32_t>{0x04});
+    CHECK(channel.update(0x05, true, post) == 0);
+    CHECK(sink.last.keys == (std::set<uint32_t>{0x04, 0x05}));
+    CHECK(channel.update(0x04, false, post) == 0);
+    CHECK(sink.last.keys == std::set<uint32_t>{0x05});
+    CHECK(channel.state().test(0x05));
+    CHECK(!channel.state().test(0x04));
+    CHECK(sink.posts == 3);
+
+    // Unrepresentable usages are rejected without posting.
+    CHECK(channel.update(1024, true, post) == 1);
+    CHECK(sink.posts == 3);
+
+    // A failing sink is reported to the caller.
+    sink.status = 7;
+    CHECK(channel.update(0x06, true, post) == 7);
+}
+
+/*
+ * Producers toggle their own keys concurrently and finish with every even
+ * key down. Afterwards the last posted report must match the bitmap, the
+ * sink must never have been entered concurrently and no call may have
+ * posted more than max_rounds reports.
+ */
+void test_concurrent_producers(int producers, int iterations) {
+    report_channel<mock_report> channel;
+    mock_sink sink;
+    std::atomic<int> too_many_posts{0};
+    std::atomic<int> wrong_status{0};
+    sink.status = 3;
+
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; ++p) {
+        threads.emplace_back([&, p] {
+            auto post = [&](const mock_report& r) { ++posts_by_this_call; return sink(r); };
+            for (int i = 0; i < iterations; ++i) {
+                for (uint32_t k = 0; k < 4; ++k) {
+                    uint32_t code = p * 4 + k;
+                    bool down     = i + 1 == iterations ? k % 2 == 0 : (i + k) % 2 == 0;
+                    posts_by_this_call = 0;
+                    if (channel.update(code, down, post) != 3) wrong_status.fetch_add(1);
+                    if (posts_by_this_call > combining_poster::max_rounds) too_many_posts.fetch_add(1);
+                }
+            }
+        });
+    }
+    for (auto& t : threads) t.join();
+
+    std::set<uint32_t> expected;
+    for (int p = 0; p < producers; ++p)
+        for (uint32_t k = 0; k < 4; k += 2) expected.insert(p * 4 + k);
+
+    CHECK(sink.last.keys == expected);
+    CHECK(sink.overlaps == 0);
+    CHECK(too_many_posts == 0);
+    CHECK(wrong_status == 0);
+    CHECK(sink.posts <= uint64_t(producers) * iterations * 4);
+}
+
+void test_device_key_state() {
+    device_key_state<4> state;
+    uint64_t a = 0x1234, b = 0x1238;   // same probe start in a 4-slot table
+
+    CHECK(state.set(a, usage_pages::keyboard_or_keypad, 0x04, true));
+    CHECK(state.set(b, usage_pages::consumer, 0xE9, true));
+    CHECK(state.test(a, usage_pages::keyboard_or_keypad, 0x04));
+    CHECK(!state.test(b, usage_pages::keyboard_or_keypad, 0x04));
+    CHECK(state.test(b, usage_pages::consumer, 0xE9));
+
+    // Untracked pages, out-of-range usages and the reserved hash are rejected.
+    CHECK(!state.set(a, 0x09, 1, true));
+    CHECK(!state.set(a, usage_pages::keyboard_or_keypad, 1024, true));
+    CHECK(!state.set(0, usage_pages::keyboard_or_keypad, 0x04, true));
+
+    std::vector<std::pair<uint32_t, uint32_t>> pressed;
+    state.set(a, usage_pages::apple_vendor_keyboard, 0x03, true);
+    state.for_each(a, [&](uint32_t page, uint32_t code) { pressed.emplace_back(page, code); });
+    CHECK(pressed == (std::vector<std::pair<uint32_t, uint32_t>>{
+        {usage_pages::keyboard_or_keypad, 0x04}, {usage_pages::apple_vendor_keyboard, 0x03}}));
+
+    // The table holds at most MaxDevices devices.
+    CHECK(state.set(3, usage_pages::keyboard_or_keypad, 0x04, true));
+    CHECK(state.set(4, usage_pages::keyboard_or_keypad, 0x04, true));
+    CHECK(!state.set(5, usage_pages::keyboard_or_keypad, 0x04, true));
+    CHECK(!state.test(5, usage_pages::keyboard_or_keypad, 0x04));
+
+    // Clearing one device leaves the others alone.
+    state.clear(a);
+    CHECK(!state.test(a, usage_pages::keyboard_or_keypad, 0x04));
+    CHECK(!state.test(a, usage_pages::apple_vendor_keyboard, 0x03));
+    CHECK(state.test(b, usage_pages::consumer, 0xE9));
+    state.clear(5);
+
+    state.set(a, usage_pages::keyboard_or_keypad, 0x04, true);
+    state.clear();
+    CHECK(!state.test(a, usage_pages::keyboard_or_keypad, 0x04));
+    CHECK(!state.test(b, usage_pages::consumer, 0xE9));
+    CHECK(state.set(a, usage_pages::keyboard_or_keypad, 0x05, true));
+}
+
+} // namespace
+
+int main() {
+    test_single_thread();
+    test_device_key_state();
+    for (int producers : {2, 4, 8})
+        test_concurrent_producers(producers, 2000);
+    return check_result();
+}
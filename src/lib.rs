@@ -22,6 +22,14 @@ mod interface {
         pub fn is_sink_ready() -> bool;
         pub fn release_input_only();
         pub fn regrab_input() -> bool;
+        pub fn is_key_down(device_hash: u64, page: u32, code: u32) -> bool;
+        pub fn is_output_key_down(page: u32, code: u32) -> bool;
+        pub fn get_pressed_keys(device_hash: u64, keys: *mut DKEvent, capacity: usize) -> usize;
+        pub fn get_output_pressed_keys(keys: *mut DKEvent, capacity: usize) -> usize;
+        pub fn set_listener_shards(count: u32) -> bool;
+        pub fn set_pointer_report_rate(rate_hz: u32) -> bool;
+        pub fn set_debounce(device_hash: u64, algorithm: u32, window_ms: u32) -> bool;
+        pub fn get_debounce_suppressed(device_hash: u64) -> u64;
     }
 
     #[repr(C)]
@@ -97,11 +105,22 @@ fn fnv1a_64(data: &str) -> u64 {
 }
 
 /// Sends a keyevent to the OS via the Karabiner-VirtualHIDDevice driver.
+/// May be called concurrently from multiple threads.
 ///
 /// Returns:
 /// - `0`: success
-/// - `1`: unrecognized usage page
+/// - `1`: unrecognized usage page, usage out of range or value other than 0/1
 /// - `2`: sink not ready (DriverKit virtual keyboard disconnected)
+/// - any other value: error returned by the kext when posting the report
+///
+/// Concurrent calls for the same page may be merged into one report posted
+/// by whichever thread got there first. Every caller still returns the
+/// status of the report that carried its own change.
+///
+/// Button page (`0x09`) events drive the virtual pointing device's buttons.
+/// For generic desktop X/Y/Wheel (`0x30`/`0x31`/`0x38`) and consumer AC Pan
+/// (`0x238`), `value` is a signed relative delta (`delta as u64`) that is
+/// coalesced and posted at the rate set by [`set_pointer_report_rate`].
 pub fn send_key(e: *mut interface::DKEvent) -> i32 {
     unsafe { interface::send_key(e) }
 }
@@ -262,3 +281,81 @@ pub fn release_input_only() {
 pub fn regrab_input() -> bool {
     unsafe { interface::regrab_input() }
 }
+
+/// Returns true if `page`/`code` is currently held on the seized device
+/// identified by `device_hash`. Lock-free; callable from any thread.
+pub fn is_key_down(device_hash: u64, page: u32, code: u32) -> bool {
+    unsafe { interface::is_key_down(device_hash, page, code) }
+}
+
+/// Returns true if `page`/`code` is currently asserted on the virtual keyboard.
+pub fn is_output_key_down(page: u32, code: u32) -> bool {
+    unsafe { interface::is_output_key_down(page, code) }
+}
+
+fn collect_pressed_keys(fill: impl Fn(*mut DKEvent, usize) -> usize) -> Vec<DKEvent> {
+    let mut keys: Vec<DKEvent> = Vec::with_capacity(16);
+    loop {
+        let len = fill(keys.as_mut_ptr(), keys.capacity());
+        if len <= keys.capacity() {
+            unsafe { keys.set_len(len) };
+            return keys;
+        }
+        keys.reserve(len);
+    }
+}
+
+/// Snapshot of the keys held on a seized device (`value` is always 1).
+pub fn pressed_keys(device_hash: u64) -> Vec<DKEvent> {
+    collect_pressed_keys(|keys, capacity| unsafe {
+        interface::get_pressed_keys(device_hash, keys, capacity)
+    })
+}
+
+/// Snapshot of the keys asserted on the virtual keyboard (`value` is always 1).
+pub fn output_pressed_keys() -> Vec<DKEvent> {
+    collect_pressed_keys(|keys, capacity| unsafe {
+        interface::get_output_pressed_keys(keys, capacity)
+    })
+}
+
+/// Chatter suppression strategy applied to a device's key events.
+#[repr(u32)]
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub enum DebounceAlgorithm {
+    /// Events pass through untouched.
+    None = 0,
+    /// Report the first edge immediately, then drop bounces within the window.
+    Eager = 1,
+    /// Report an edge only after the key stayed in that state for the window.
+    Deferred = 2,
+}
+
+/// Configures debouncing for the device identified by `device_hash`, using
+/// the hardware event timestamps. Has to be called before grab() or
+/// regrab_input(); returns false while input is grabbed, since the
+/// configuration is frozen then.
+pub fn set_debounce(device_hash: u64, algorithm: DebounceAlgorithm, window_ms: u32) -> bool {
+    unsafe { interface::set_debounce(device_hash, algorithm as u32, window_ms) }
+}
+
+/// Returns how many events have been dropped as chatter on a device.
+/// Safe to call from any thread while input is grabbed; while released it
+/// must not race with set_debounce().
+pub fn debounce_suppressed(device_hash: u64) -> u64 {
+    unsafe { interface::get_debounce_suppressed(device_hash) }
+}
+
+/// Spreads seized devices over `count` listener threads (1 to 16), each with
+/// its own run loop. Events are still delivered by wait_key() in arrival
+/// order. Has to be called before grab() or regrab_input().
+pub fn set_listener_shards(count: u32) -> bool {
+    unsafe { interface::set_listener_shards(count) }
+}
+
+/// Sets how many pointer reports per second coalesced motion is flushed at
+/// (e.g. 125, 250 or 1000; default 125). `0` posts every motion event
+/// immediately. Returns false for rates above 1000.
+pub fn set_pointer_report_rate(rate_hz: u32) -> bool {
+    unsafe { interface::set_pointer_report_rate(rate_hz) }
+}